@@ -0,0 +1,152 @@
+// Connection behavior on emulated links, for Linux hosts.
+//
+// Measures handshake time, ping round trip time, the time to transfer a large
+// message and the closing handshake of a client and a server connection
+// talking through PicoWebsocket::Emulator::Network, for a few link profiles.
+// All times are virtual, so the results are deterministic and the whole run
+// takes just a moment of real time.
+//
+// The benchmark needs an Arduino compatibility layer for Linux, for example
+// EpoxyDuino (https://github.com/bxparks/EpoxyDuino), which provides
+// Arduino.h, Client.h and friends.  Build it like any other EpoxyDuino
+// application with PicoWebsocket in ARDUINO_LIBS.
+
+#include <Arduino.h>
+#include <PicoWebsocket.h>
+#include <PicoWebsocketEmulator.h>
+
+#include <list>
+#include <vector>
+
+namespace {
+
+const uint16_t port = 80;
+const size_t message_size = 100000;
+
+struct Profile {
+    const char * name;
+    unsigned long bandwidth;
+    unsigned long latency_us;
+    unsigned long jitter_us;
+    float loss;
+};
+
+const Profile profiles[] = {
+    {"lan", 10000000, 500, 0, 0},
+    {"wifi", 1000000, 5000, 2000, 0.01},
+    {"weak wifi", 200000, 20000, 10000, 0.05},
+    {"cellular", 100000, 50000, 20000, 0.02},
+};
+
+using Server = PicoWebsocket::Server<PicoWebsocket::Emulator::Server>;
+
+class PingClient : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+    unsigned long pong_ms = 0;
+
+protected:
+    virtual void on_pong(const void *, size_t) override {
+        pong_ms = PicoWebsocket::clock_millis();
+    }
+};
+
+void measure(const Profile & profile) {
+    PicoWebsocket::Emulator::Network network;
+    network.upstream.bandwidth = profile.bandwidth;
+    network.upstream.latency_us = profile.latency_us;
+    network.upstream.jitter_us = profile.jitter_us;
+    network.upstream.loss = profile.loss;
+    // like a small TCP stack on a microcontroller
+    network.upstream.send_buffer = 5744;
+    network.upstream.max_write_chunk = 1436;
+    network.upstream.max_read_chunk = 536;
+    network.downstream = network.upstream;
+
+    PicoWebsocket::Emulator::Server server_socket(network, port);
+    Server server(server_socket);
+    server.wait_strategy = &network;
+    server_socket.begin();
+
+    PicoWebsocket::Emulator::Client client_socket(network);
+    PingClient client(client_socket, "/");
+    client.wait_strategy = &network;
+
+    // handshake
+    unsigned long start_ms = PicoWebsocket::clock_millis();
+    std::list<Server::Client> connections;
+    client.start_connect("server", port);
+    while (client.poll_connect() != PicoWebsocket::Client::ConnectState::open) {
+        if (client.get_connect_state() ==
+            PicoWebsocket::Client::ConnectState::failed) {
+            Serial.printf("%-12s handshake failed\n", profile.name);
+            return;
+        }
+        if (connections.empty() &&
+            (client.get_connect_state() ==
+             PicoWebsocket::Client::ConnectState::request_sent)) {
+            connections.push_back(server.accept());
+        }
+        if (!network.step()) {
+            network.advance_ms(1);
+        }
+    }
+    const unsigned long handshake_ms = PicoWebsocket::clock_millis() - start_ms;
+    Server::Client & connection = connections.front();
+
+    // keepalive
+    start_ms = PicoWebsocket::clock_millis();
+    client.ping();
+    while (!client.pong_ms && network.step()) {
+        connection.available();
+        client.available();
+    }
+    const unsigned long ping_ms = client.pong_ms - start_ms;
+
+    // throughput, the write blocks in virtual time until the data is sent
+    std::vector<uint8_t> message(message_size);
+    start_ms = PicoWebsocket::clock_millis();
+    client.write(message.data(), message.size());
+    size_t received = 0;
+    while (received < message_size) {
+        uint8_t buffer[1024];
+        const int bytes_read = connection.read(buffer, sizeof(buffer));
+        received += bytes_read;
+        if (!bytes_read && !network.step()) {
+            break;
+        }
+    }
+    const unsigned long transfer_ms = PicoWebsocket::clock_millis() - start_ms;
+
+    // close
+    start_ms = PicoWebsocket::clock_millis();
+    client.begin_close(1000);
+    while (!client.poll_close()) {
+        connection.available();
+        if (!network.step()) {
+            network.advance_ms(10);
+        }
+    }
+    const unsigned long close_ms = PicoWebsocket::clock_millis() - start_ms;
+
+    Serial.printf("%-12s %10lu %10lu %10lu %10.1f %10lu %10lu\n", profile.name,
+                  handshake_ms, ping_ms, transfer_ms,
+                  1.0 * received / transfer_ms, close_ms,
+                  network.retransmissions);
+}
+
+}  // namespace
+
+void setup() {
+    Serial.printf("%zu byte message, times in virtual ms\n", message_size);
+    Serial.printf("%-12s %10s %10s %10s %10s %10s %10s\n", "link", "handshake",
+                  "ping", "transfer", "kB/s", "close", "retransmit");
+
+    for (const Profile & profile : profiles) {
+        measure(profile);
+    }
+
+    exit(0);
+}
+
+void loop() {}
@@ -0,0 +1,124 @@
+// Sharded server throughput benchmark for Linux hosts.
+//
+// Runs an echo server with 1, 2, ... N shards and measures the number of
+// messages echoed per second by a fixed set of client connections.  Client
+// connections are driven by their own threads, so make sure the machine has
+// enough cores to generate the load.
+//
+// The benchmark needs an Arduino compatibility layer for Linux, for example
+// EpoxyDuino (https://github.com/bxparks/EpoxyDuino), which provides
+// Arduino.h, Client.h and friends.  Build it like any other EpoxyDuino
+// application with PicoWebsocket in ARDUINO_LIBS.
+
+#include <Arduino.h>
+#include <PicoWebsocketPosix.h>
+#include <PicoWebsocketSharded.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint16_t port = 18080;
+const size_t client_count = 64;
+const size_t message_size = 256;
+const size_t pipeline_depth = 8;
+const unsigned long duration_ms = 3000;
+
+using ServerBase = PicoWebsocket::ShardedServer<PicoWebsocket::Posix::Server>;
+
+class EchoServer : public ServerBase {
+public:
+    using ShardedServer::ShardedServer;
+    virtual ~EchoServer() { end(); }
+
+protected:
+    virtual void on_data(Shard & shard, Client & client) override {
+        uint8_t buffer[message_size];
+        const int bytes_read = client.read(buffer, message_size);
+        client.write(buffer, bytes_read);
+    }
+};
+
+// Keep pipeline_depth messages in flight and count echoed bytes.
+void run_client(std::atomic<bool> & running, std::atomic<size_t> & echoed) {
+    PicoWebsocket::Posix::Client socket;
+    PicoWebsocket::Client websocket(socket);
+    if (!websocket.connect("127.0.0.1", port)) {
+        Serial.println("Client connect failed");
+        return;
+    }
+
+    uint8_t buffer[message_size] = {};
+    for (size_t i = 0; i < pipeline_depth; ++i) {
+        websocket.write(buffer, message_size);
+    }
+
+    size_t received = 0;
+    while (running && websocket.connected()) {
+        const int bytes_read = websocket.read(buffer, message_size);
+        received += bytes_read;
+        while (received >= message_size) {
+            received -= message_size;
+            echoed += 1;
+            websocket.write(buffer, message_size);
+        }
+    }
+
+    websocket.stop();
+}
+
+double measure(size_t shard_count) {
+    PicoWebsocket::Posix::Server socket(port, nullptr, client_count);
+    EchoServer server(socket, shard_count);
+    server.begin();
+
+    std::atomic<bool> running(true);
+    std::atomic<size_t> echoed(0);
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < client_count; ++i) {
+        clients.emplace_back(run_client, std::ref(running), std::ref(echoed));
+    }
+
+    // accept all connections first
+    while (server.shard_connections() < client_count) {
+        if (!server.loop()) {
+            socket.wait(10);
+        }
+    }
+
+    const size_t start_count = echoed;
+    const unsigned long start_time = millis();
+    delay(duration_ms);
+    const size_t count = echoed - start_count;
+    const unsigned long elapsed_ms = millis() - start_time;
+
+    running = false;
+    server.end();
+    for (auto & client : clients) {
+        client.join();
+    }
+
+    return 1000.0 * count / elapsed_ms;
+}
+
+}  // namespace
+
+void setup() {
+    const size_t max_shards = std::max(1u, std::thread::hardware_concurrency());
+
+    Serial.printf("%zu clients, %zu byte messages, %zu in flight per client\n",
+                  client_count, message_size, pipeline_depth);
+    Serial.printf("%8s %14s %14s\n", "shards", "messages/s", "per shard");
+
+    for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+        const double rate = measure(shards);
+        Serial.printf("%8zu %14.0f %14.0f\n", shards, rate, rate / shards);
+    }
+
+    exit(0);
+}
+
+void loop() {}
@@ -12,12 +12,17 @@
 #endif
 
 #include <PicoWebsocket.h>
+#include <PicoWebsocketScheduler.h>
 
 ::WiFiServer server(80);
 PicoWebsocket::Server<::WiFiServer> websocket_server(server);
 
 std::list<PicoWebsocket::Server<::WiFiServer>::Client> websocket_clients;
 
+// Give each client up to 256 bytes per loop() iteration, so a single busy
+// client can't starve the others.
+PicoWebsocket::FairScheduler scheduler(256);
+
 void setup() {
     Serial.begin(115200);
 
@@ -41,25 +46,26 @@ void loop() {
     }
 
     for (auto it = websocket_clients.begin(); it != websocket_clients.end();) {
-        auto & websocket = *it;
-
-        if (!websocket.connected()) {
+        if (!it->connected()) {
             Serial.println("Client disconnected");
             it = websocket_clients.erase(it);
             continue;
         }
+        ++it;
+    }
 
-        if (websocket.available()) {
-            uint8_t buffer[128];
-            const auto bytes_read = websocket.read(buffer, 128);
-            Serial.printf("Received %u bytes\n", bytes_read);
+    scheduler.run(websocket_clients, [](PicoWebsocket::ServerClient & websocket,
+                                        size_t budget) {
+        uint8_t buffer[128];
+        const auto bytes_read =
+            websocket.read(buffer, budget < 128 ? budget : 128);
+        Serial.printf("Received %u bytes\n", bytes_read);
 
-            // forward to all connected clients
-            for (auto & websocket2 : websocket_clients) {
-                websocket2.write(buffer, bytes_read);
-            }
+        // forward to all connected clients
+        for (auto & websocket2 : websocket_clients) {
+            websocket2.write(buffer, bytes_read);
         }
 
-        ++it;
-    }
+        return (size_t)bytes_read;
+    });
 }
@@ -10,6 +10,7 @@
 #endif
 
 #include "PicoWebsocket.h"
+#include "PicoWebsocketMemory.h"
 
 #ifdef PICOWEBSOCKET_DEBUG
 #define PICOWEBSOCKET_DEBUG_PRINTF(...) Serial.printf("DBG " __VA_ARGS__)
@@ -104,15 +105,59 @@ bool header_contains(const String & header, const String & value) {
     return false;
 }
 
+// Holds a part of the memory budget for the duration of a scope.
+class MemoryReservation {
+public:
+    MemoryReservation(PicoWebsocket::MemoryBudget * budget, size_t size)
+        : budget(budget), size(size), ok(!budget || budget->acquire(size)) {}
+    ~MemoryReservation() {
+        if (budget && ok) {
+            budget->release(size);
+        }
+    }
+
+    PicoWebsocket::MemoryBudget * const budget;
+    const size_t size;
+    const bool ok;
+};
+
 }  // namespace
 
 namespace PicoWebsocket {
 
+Clock * active_clock = nullptr;
+
+Clock * set_clock(Clock * clock) {
+    Clock * previous = active_clock;
+    active_clock = clock;
+    return previous;
+}
+
+void ClientBase::wait_for_socket(WaitStrategy::Event event,
+                                 unsigned long timeout_ms,
+                                 unsigned int attempt) {
+    if (wait_strategy) {
+        wait_strategy->wait(client, event, timeout_ms, attempt);
+    } else {
+        yield();
+    }
+}
+
 size_t ClientBase::write_all(const void * buffer, const size_t size) {
     size_t bytes_written = 0;
+    unsigned int attempt = 0;
     while (client.connected() && (bytes_written < size)) {
-        bytes_written += client.write(((uint8_t *)buffer) + bytes_written,
-                                      size - bytes_written);
+        const size_t written = client.write(
+            ((uint8_t *)buffer) + bytes_written, size - bytes_written);
+        if (written) {
+            bytes_written += written;
+            attempt = 0;
+        } else {
+            // send buffer full
+            ++write_waits;
+            wait_for_socket(WaitStrategy::Event::writable, socket_timeout_ms,
+                            attempt++);
+        }
     }
     return bytes_written == size ? size : 0;
 }
@@ -120,23 +165,25 @@ size_t ClientBase::write_all(const void * buffer, const size_t size) {
 size_t ClientBase::read_all(const void * buffer, const size_t size,
                             const unsigned long timeout_ms) {
     size_t bytes_read = 0;
-    const unsigned long start_time = millis();
+    const unsigned long start_time = clock_millis();
 
     while (bytes_read < size) {
+        unsigned int attempt = 0;
         while (!client.available()) {
             if (!client.connected()) {
                 // connection lost already
                 return 0;
             }
             // connection intact, but no data yet -- timout exceeded?
-            const unsigned long elapsed_ms = millis() - start_time;
+            const unsigned long elapsed_ms = clock_millis() - start_time;
             if (elapsed_ms >= socket_timeout_ms) {
                 // timeout, drop connection
                 client.stop();
                 return 0;
             }
             // wait a little more
-            yield();
+            wait_for_socket(WaitStrategy::Event::readable,
+                            socket_timeout_ms - elapsed_ms, attempt++);
         }
 
         // there's some data waiting in buffers to be read
@@ -150,13 +197,61 @@ size_t ClientBase::read_all(const void * buffer, const size_t size,
 ClientBase::ClientBase(::Client & client, unsigned long socket_timeout_ms,
                        bool is_client)
     : socket_timeout_ms(socket_timeout_ms),
+      max_frame_size(0),
+      adaptive_framing(false),
+      min_frame_size(128),
+      memory_budget(nullptr),
+      max_incoming_frame_size(0),
+      max_incoming_message_size(0),
+      tap(nullptr),
+      wait_strategy(nullptr),
+      coalesce_pongs(false),
+      max_control_frame_rate(0),
       client(client),
       is_client(is_client),
-      mask(0),
+      in_mask(0),
+      out_mask(0),
       in_frame_size(0),
       in_frame_pos(0),
+      in_frame_fin(true),
+      head_start_size(0),
+      in_message_size(0),
+      last_received_ms(clock_millis()),
+      adaptive_frame_size(1024),
+      write_waits(0),
+      clean_frames(0),
+      in_message(false),
       write_continue(false),
-      closing(false) {}
+      closing(false),
+      sink_message(false),
+      sink_message_fin(true),
+      view_buffer(nullptr),
+      view_begin(0),
+      view_end(0),
+      control_window_ms(0),
+      control_frame_count(0),
+      split_mode(false),
+      pong_state(PONG_NONE),
+      pong_size(0),
+      pending_close(-1) {}
+
+ClientBase::~ClientBase() { free_view_buffer(); }
+
+void ClientBase::free_view_buffer() {
+    if (!view_buffer) {
+        return;
+    }
+    free(view_buffer);
+    view_buffer = nullptr;
+    if (memory_budget) {
+        memory_budget->release(PICOWEBSOCKET_VIEW_BUFFER_SIZE);
+    }
+}
+
+void ClientBase::mask_payload(void * data, uint32_t mask, size_t size,
+                              size_t offset) {
+    apply_mask(data, mask, size, offset);
+}
 
 size_t ClientBase::read_payload(void * buffer, const size_t size,
                                 const bool all) {
@@ -165,10 +260,17 @@ size_t ClientBase::read_payload(void * buffer, const size_t size,
 
     if (!is_client) {
         // we're the server, the received data is masked
-        apply_mask(buffer, mask, bytes_read, in_frame_pos);
+        apply_mask(buffer, in_mask, bytes_read, in_frame_pos);
+    }
+
+    if (tap && bytes_read) {
+        tap->on_frame_payload(false, buffer, bytes_read);
     }
 
     in_frame_pos += bytes_read;
+    if (bytes_read) {
+        last_received_ms = clock_millis();
+    }
 
     return bytes_read;
 }
@@ -183,15 +285,22 @@ size_t ClientBase::write_payload(const void * payload, const size_t size) {
             const size_t chunk_size =
                 (size - written) < buffer_size ? (size - written) : buffer_size;
             memcpy(buffer, ((const char *)payload) + written, chunk_size);
-            apply_mask(buffer, mask, chunk_size, written);
+            apply_mask(buffer, out_mask, chunk_size, written);
             if (!write_all(buffer, chunk_size)) {
                 break;
             }
             written += chunk_size;
         }
+        if (tap && written) {
+            tap->on_frame_payload(true, payload, written);
+        }
         return written;
     } else {
-        return write_all(payload, size);
+        const size_t written = write_all(payload, size);
+        if (tap && written) {
+            tap->on_frame_payload(true, payload, written);
+        }
+        return written;
     }
 }
 
@@ -201,6 +310,26 @@ size_t ClientBase::write_frame(Opcode opcode, bool fin, const void * payload,
     return write_payload(payload, size);
 }
 
+size_t ClientBase::write_encoded_frame(const uint8_t * frame, size_t head_size,
+                                       size_t payload_size) {
+    if (is_client || write_continue || closing) {
+        // frames sent by clients must be masked individually and data frames
+        // can't be sent in the middle of a fragmented message or after close
+        return 0;
+    }
+
+    PICOWEBSOCKET_DEBUG_PRINTF("Frame send: opcode=%1x fin=%i len=%u encoded\n",
+                               frame[0] & 0x0f, frame[0] >> 7, payload_size);
+
+    if (tap) {
+        tap->on_frame_head(true, frame[0] & 0x0f, frame[0] & 0x80,
+                           payload_size);
+        tap->on_frame_payload(true, frame + head_size, payload_size);
+    }
+
+    return write_all(frame, head_size + payload_size) ? payload_size : 0;
+}
+
 void ClientBase::pong(const void * payload, size_t size) {
     write_frame(Opcode::CTRL_PONG, true, payload, size);
 }
@@ -226,34 +355,447 @@ void ClientBase::close(const uint16_t code) {
     write_frame(Opcode::CTRL_CLOSE, true, buffer, frame_length);
 }
 
+void ClientBase::reply_pong(const void * payload, size_t size) {
+    if (!split_mode && !coalesce_pongs) {
+        pong(payload, size);
+        return;
+    }
+
+    // Claim the slot, unless the writer is copying out the previous reply.
+    // That takes very little time, so just wait for it to finish.
+    uint8_t state = pong_state.load(std::memory_order_relaxed);
+    while ((state == PONG_SENDING) ||
+           !pong_state.compare_exchange_weak(state, PONG_WRITING,
+                                             std::memory_order_acquire)) {
+        if (state == PONG_SENDING) {
+            yield();
+            state = pong_state.load(std::memory_order_relaxed);
+        }
+    }
+
+    pong_size = size < sizeof(pong_payload) ? size : sizeof(pong_payload);
+    memcpy(pong_payload, payload, pong_size);
+    pong_state.store(PONG_READY, std::memory_order_release);
+}
+
+void ClientBase::reply_close(uint16_t code, bool disconnect) {
+    if (!split_mode) {
+        close(code);
+        if (disconnect) {
+            client.stop();
+        }
+        return;
+    }
+
+    pending_close.store(code | (disconnect ? 0x10000 : 0),
+                        std::memory_order_release);
+}
+
+void ClientBase::send_control_replies() {
+    uint8_t state = PONG_READY;
+    if (pong_state.compare_exchange_strong(state, PONG_SENDING,
+                                           std::memory_order_acquire)) {
+        uint8_t payload[sizeof(pong_payload)];
+        const size_t size = pong_size;
+        memcpy(payload, pong_payload, size);
+        pong_state.store(PONG_NONE, std::memory_order_release);
+        pong(payload, size);
+    }
+
+    const int32_t request =
+        pending_close.exchange(-1, std::memory_order_acquire);
+    if (request >= 0) {
+        if (!closing) {
+            close(request & 0xffff);
+        }
+        if (request & 0x10000) {
+            client.stop();
+        }
+    }
+}
+
+void ClientBase::flush_control_replies() {
+    if (!split_mode && (pong_state.load(std::memory_order_relaxed) ==
+                        PONG_READY)) {
+        send_control_replies();
+    }
+}
+
+bool ClientBase::check_control_frame_rate() {
+    if (!max_control_frame_rate) {
+        return true;
+    }
+
+    const unsigned long now = clock_millis();
+    if (now - control_window_ms >= 1000) {
+        control_window_ms = now;
+        control_frame_count = 0;
+    }
+
+    return ++control_frame_count <= max_control_frame_rate;
+}
+
 void ClientBase::stop() { stop(1000); }
 
 void ClientBase::stop(uint16_t code) {
-    close(code);
-    const unsigned long start_time = millis();
-    while (client.connected() && (millis() - start_time <= socket_timeout_ms)) {
-        if (!await_data_frame()) {
+    begin_close(code);
+    const unsigned long start_time = clock_millis();
+    unsigned int attempt = 0;
+    while (!poll_close()) {
+        const unsigned long elapsed_ms = clock_millis() - start_time;
+        if (elapsed_ms > socket_timeout_ms) {
+            break;
+        }
+        wait_for_socket(WaitStrategy::Event::readable,
+                        socket_timeout_ms - elapsed_ms, attempt++);
+    }
+}
+
+void ClientBase::begin_close(uint16_t code) {
+    if (split_mode) {
+        // only the writer may send frames
+        reply_close(code, false);
+    } else if (!closing) {
+        close(code);
+    }
+    view_begin = view_end = 0;
+}
+
+bool ClientBase::poll_close() {
+    while (client.connected() &&
+           (client.available() || (head_start_size == 2))) {
+        if (in_frame_pos < in_frame_size) {
+            // data frame received, discard it
+            discard_payload(in_frame_size - in_frame_pos);
+            continue;
+        }
+
+        // Don't wait for the rest of a partially received header.  Its
+        // length is known once the first two bytes are in, keep them until
+        // the rest arrives.
+        if (head_start_size < 2) {
+            const int bytes_read = client.read(head_start + head_start_size,
+                                               2 - head_start_size);
+            if (bytes_read <= 0) {
+                break;
+            }
+            head_start_size += bytes_read;
+            continue;
+        }
+
+        // control frames are handled as a whole, wait for their payload too
+        const uint8_t length = head_start[1] & 0x7f;
+        const bool control = head_start[0] & 0x08;
+        const size_t needed =
+            ((length == 126) ? 2 : ((length == 127) ? 8 : 0)) +
+            ((head_start[1] & 0x80) ? 4 : 0) + (control ? length : 0);
+        if ((size_t)client.available() < needed) {
+            break;
+        }
+
+        const Opcode opcode = read_head();
+        if (opcode == Opcode::ERR) {
+            break;
+        }
+        if ((uint8_t)opcode & 0x8) {
+            handle_control_frame(opcode);
+        }
+    }
+    return !client.connected();
+}
+
+size_t ClientBase::discard_payload(const size_t size) {
+    // Read whatever is available in big chunks.  There's no need to unmask
+    // the data, nobody is going to look at it.
+    uint8_t buffer[128];
+    size_t discarded = 0;
+    while (discarded < size) {
+        const size_t remaining = size - discarded;
+        const int bytes_read = client.read(
+            buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+        if (bytes_read <= 0) {
+            break;
+        }
+        if (tap) {
+            // the data is unmasked only for the tap
+            if (!is_client) {
+                apply_mask(buffer, in_mask, bytes_read,
+                           in_frame_pos + discarded);
+            }
+            tap->on_frame_payload(false, buffer, bytes_read);
+        }
+        discarded += bytes_read;
+    }
+    in_frame_pos += discarded;
+    return discarded;
+}
+
+bool ClientBase::skip_frame() {
+    view_begin = view_end = 0;
+
+    unsigned long start_time = clock_millis();
+    unsigned int attempt = 0;
+    while (in_frame_pos < in_frame_size) {
+        if (discard_payload(in_frame_size - in_frame_pos)) {
+            start_time = clock_millis();
+            attempt = 0;
             continue;
         }
 
-        // data frame received, discard it
-        while ((in_frame_pos < in_frame_size) &&
-               (millis() - start_time <= socket_timeout_ms)) {
-            // We could read more data at a time and improve performance,
-            // but this code is rarely reached and can only run once per
-            // connection, so the impact is minimal.
-            uint8_t c;
-            read_payload(&c, 1);
+        if (!client.connected()) {
+            return false;
         }
+
+        const unsigned long elapsed_ms = clock_millis() - start_time;
+        if (elapsed_ms >= socket_timeout_ms) {
+            // timeout, drop connection
+            client.stop();
+            return false;
+        }
+
+        wait_for_socket(WaitStrategy::Event::readable,
+                        socket_timeout_ms - elapsed_ms, attempt++);
+    }
+
+    return true;
+}
+
+bool ClientBase::skip_message() {
+    while (true) {
+        if (!skip_frame()) {
+            return false;
+        }
+
+        if (!in_message) {
+            // that was the last frame
+            return true;
+        }
+
+        // wait for the next fragment
+        const Opcode opcode = read_head();
+        switch (opcode) {
+            case Opcode::DATA_CONTINUATION: {
+                in_message = !in_frame_fin;
+                break;
+            }
+
+            case Opcode::DATA_TEXT:
+            case Opcode::DATA_BINARY: {
+                // new message started before the previous one ended
+                on_violation();
+                return false;
+            }
+
+            case Opcode::ERR: {
+                return false;
+            }
+
+            default: {
+                handle_control_frame(opcode);
+                if (!client.connected()) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+}
+
+size_t ClientBase::next_frame_size(size_t remaining) {
+    size_t limit = max_frame_size;
+    if (adaptive_framing) {
+        limit = adaptive_frame_size;
+        if (max_frame_size && (limit > max_frame_size)) {
+            limit = max_frame_size;
+        }
+    }
+    return (limit && (remaining > limit)) ? limit : remaining;
+}
+
+void ClientBase::update_adaptive_frame_size(size_t frame_size) {
+    size_t upper = PICOWEBSOCKET_ADAPTIVE_FRAME_SIZE_LIMIT;
+    if (max_frame_size) {
+        upper = max_frame_size;
+    }
+    const size_t lower = min_frame_size < upper ? min_frame_size : upper;
+
+    size_t new_size = adaptive_frame_size;
+    if (!write_waits) {
+        if ((frame_size >= adaptive_frame_size) && (++clean_frames >= 4)) {
+            // full sized frames keep going out without pushback, go bigger
+            new_size = adaptive_frame_size * 2;
+            clean_frames = 0;
+        }
+    } else if (write_waits > 1) {
+        // The frame had to wait for the send buffer more than once, so it's
+        // bigger than what the link takes at a time.  Aim for one wait per
+        // frame, but don't shrink by more than half at once.
+        clean_frames = 0;
+        new_size = frame_size / write_waits;
+        if (new_size < adaptive_frame_size / 2) {
+            new_size = adaptive_frame_size / 2;
+        }
+        if (new_size > adaptive_frame_size) {
+            new_size = adaptive_frame_size;
+        }
+    } else {
+        // a single wait per frame is the sweet spot under load
+        clean_frames = 0;
+    }
+
+    if (new_size < lower) {
+        new_size = lower;
+    }
+    if (new_size > upper) {
+        new_size = upper;
+    }
+
+    if (new_size != adaptive_frame_size) {
+        PICOWEBSOCKET_DEBUG_PRINTF(
+            "Adaptive frame size %u -> %u (waits=%u)\n",
+            adaptive_frame_size, new_size, write_waits);
+        adaptive_frame_size = new_size;
     }
 }
 
 size_t ClientBase::write(const void * buffer, size_t size, bool fin, bool bin) {
-    const Opcode opcode = write_continue
-                              ? Opcode::DATA_CONTINUATION
-                              : (bin ? Opcode::DATA_BINARY : Opcode::DATA_TEXT);
-    write_continue = !fin;
-    return write_frame(opcode, fin, buffer, size);
+    size_t written = 0;
+    while (true) {
+        const size_t frame_size = next_frame_size(size - written);
+        const bool last = (frame_size == size - written);
+
+        if (split_mode) {
+            // replies queued by the reader go out between frames
+            send_control_replies();
+            if (closing) {
+                return written;
+            }
+        } else {
+            flush_control_replies();
+        }
+
+        const Opcode opcode =
+            write_continue ? Opcode::DATA_CONTINUATION
+                           : (bin ? Opcode::DATA_BINARY : Opcode::DATA_TEXT);
+        write_continue = !(fin && last);
+
+        write_waits = 0;
+        const size_t ret = write_frame(opcode, fin && last,
+                                       (const uint8_t *)buffer + written,
+                                       frame_size);
+        written += ret;
+
+        if (adaptive_framing && (ret == frame_size)) {
+            update_adaptive_frame_size(frame_size);
+        }
+
+        if (last || (ret != frame_size)) {
+            return written;
+        }
+
+        // more fragments to go, give control frames a chance
+        if (!split_mode) {
+            handle_pending_control_frames();
+        }
+    }
+}
+
+void ClientBase::handle_pending_control_frames() {
+    // Incoming control frames can only be handled if they're next in line.
+    // If we're in the middle of an incoming data frame or if the next frame is
+    // a data frame, they will have to wait until the application reads data.
+    while (client.available() && (in_frame_pos >= in_frame_size)) {
+        const int c = client.peek();
+        if ((c < 0) || !(c & 0x08)) {
+            // not a control frame
+            break;
+        }
+
+        const Opcode opcode = read_head();
+        if (opcode == Opcode::ERR) {
+            break;
+        }
+        handle_control_frame(opcode);
+    }
+    flush_control_replies();
+}
+
+void ClientBase::handle_control_frame(const Opcode opcode) {
+    switch (opcode) {
+        case Opcode::CTRL_CLOSE: {
+            uint8_t buf[in_frame_size];
+            if (!read_payload(buf, in_frame_size, true)) {
+                // read failed, we're already disconnected
+                break;
+            }
+
+            const uint16_t code =
+                (in_frame_size >= 2)
+                    ? (((uint16_t)buf[0] << 8) | (uint16_t)buf[1])
+                    : 0;
+            PICOWEBSOCKET_DEBUG_PRINTF("Received close, code=%i\n", code);
+
+            if (!closing) {
+                // WebSocket was not in closing state.  We're entering it
+                // now. We could send a close reply later, but we do it
+                // right away as we're not allowed to send any data frames
+                // from this point on anyway.  The connection can be closed
+                // once the reply is out.
+                reply_close(code, true);
+            } else {
+                // We were in closing state, the connection can be closed
+                // now.
+                client.stop();
+            }
+            break;
+        }
+
+        case Opcode::CTRL_PING:
+        case Opcode::CTRL_PONG: {
+            if (!check_control_frame_rate()) {
+                PICOWEBSOCKET_DEBUG_PRINTF("Control frame rate exceeded\n");
+                on_violation(1008);
+                break;
+            }
+
+            char buf[in_frame_size];
+            if (in_frame_size && !read_payload(buf, in_frame_size, true)) {
+                // read failed, we're already disconnected
+                break;
+            }
+
+            if (opcode == Opcode::CTRL_PING) {
+                reply_pong(buf, in_frame_size);
+            } else {
+                on_pong(buf, in_frame_size);
+            }
+
+            // If another control frame follows, it may be a ping which makes
+            // a queued reply obsolete.  Otherwise send it right away.
+            const int next = client.available() ? client.peek() : -1;
+            if ((next < 0) || !(next & 0x08)) {
+                flush_control_replies();
+            }
+            break;
+        }
+
+        default: {
+            on_violation();
+            break;
+        }
+    }
+}
+
+bool ClientBase::reads_paused() {
+    // Under memory pressure new messages are left in the socket, so that TCP
+    // flow control slows the peer down until memory is released.  Control
+    // frames in front of them are still handled, so that pings are answered
+    // and closing handshakes complete.
+    if (in_message || !memory_budget || !memory_budget->under_pressure()) {
+        return false;
+    }
+    handle_pending_control_frames();
+    return true;
 }
 
 bool ClientBase::await_data_frame() {
@@ -265,8 +807,10 @@ bool ClientBase::await_data_frame() {
             case Opcode::DATA_TEXT:
             case Opcode::DATA_BINARY: {
                 // TODO: Handle state transitions
+                in_message = !in_frame_fin;
                 if (in_frame_size) {
                     // the new frame is non-empty
+                    flush_control_replies();
                     return true;
                 }
 
@@ -274,65 +818,139 @@ bool ClientBase::await_data_frame() {
                 break;
             }
 
-            case Opcode::CTRL_CLOSE: {
-                uint8_t buf[in_frame_size];
-                if (!read_payload(buf, in_frame_size, true)) {
-                    // read failed, we're already disconnected
-                    break;
-                }
+            default: {
+                handle_control_frame(opcode);
+                break;
+            }
+        }
+    }
+    flush_control_replies();
+    return false;
+}
 
-                const uint16_t code =
-                    (in_frame_size >= 2)
-                        ? (((uint16_t)buf[0] << 8) | (uint16_t)buf[1])
-                        : 0;
-                PICOWEBSOCKET_DEBUG_PRINTF("Received close, code=%i\n", code);
-
-                if (!closing) {
-                    // WebSocket was not in closing state.  We're entering it
-                    // now. We could send a close reply later, but we do it
-                    // right away as we're not allowed to send any data frames
-                    // from this point on anyway.
-                    close(code);
-                }
+size_t ClientBase::receive(MessageSink & sink) {
+    if (closing) {
+        // nothing is passed to the sink anymore
+        poll_close();
+        return 0;
+    }
 
-                // We were in closing state or have just entered it.
-                // The connection can be closed now.
-                client.stop();
+    size_t received = 0;
+
+    while (client.connected()) {
+        if (in_frame_pos < in_frame_size) {
+            // in the middle of a data frame, pass on what's available
+            const size_t socket_available = client.available();
+            if (!socket_available) {
                 break;
             }
 
-            case Opcode::CTRL_PING:
-            case Opcode::CTRL_PONG: {
-                char buf[in_frame_size];
-                if (in_frame_size && !read_payload(buf, in_frame_size, true)) {
-                    // read failed, we're already disconnected
-                    break;
+            uint8_t buffer[PICOWEBSOCKET_SINK_CHUNK_SIZE];
+            size_t chunk_size = in_frame_size - in_frame_pos;
+            if (chunk_size > socket_available) {
+                chunk_size = socket_available;
+            }
+            if (chunk_size > sizeof(buffer)) {
+                chunk_size = sizeof(buffer);
+            }
+
+            chunk_size = read_payload(buffer, chunk_size);
+            if (!chunk_size) {
+                break;
+            }
+            received += chunk_size;
+
+            if (!sink.on_message_data(buffer, chunk_size)) {
+                PICOWEBSOCKET_DEBUG_PRINTF("Message rejected by sink\n");
+                sink_message = false;
+                sink.on_message_abort();
+                // don't wait for the close reply here, further calls drive
+                // the close handshake
+                begin_close(1011);
+                return received;
+            }
+            continue;
+        }
+
+        if (sink_message && sink_message_fin) {
+            // last frame of the message complete
+            sink_message = false;
+            sink.on_message_end();
+            continue;
+        }
+
+        if (!client.available() || (!sink_message && reads_paused())) {
+            break;
+        }
+
+        const Opcode opcode = read_head();
+        switch (opcode) {
+            case Opcode::DATA_TEXT:
+            case Opcode::DATA_BINARY: {
+                if (sink_message) {
+                    // previous message was not finished
+                    sink_message = false;
+                    sink.on_message_abort();
+                    on_violation();
+                    return received;
                 }
+                sink_message = true;
+                sink_message_fin = in_frame_fin;
+                sink.on_message_begin(opcode == Opcode::DATA_BINARY,
+                                      in_frame_size, !in_frame_fin);
+                break;
+            }
 
-                if (opcode == Opcode::CTRL_PING) {
-                    pong(buf, in_frame_size);
-                } else {
-                    on_pong(buf, in_frame_size);
+            case Opcode::DATA_CONTINUATION: {
+                if (!sink_message) {
+                    // continuation of nothing
+                    on_violation();
+                    return received;
                 }
+                sink_message_fin = in_frame_fin;
+                break;
+            }
+
+            case Opcode::ERR: {
+                // connection dropped or closing already
                 break;
             }
 
             default: {
-                on_violation();
+                handle_control_frame(opcode);
                 break;
             }
         }
+
+        if (opcode == Opcode::ERR) {
+            break;
+        }
     }
-    return false;
+
+    if (sink_message && !client.connected()) {
+        sink_message = false;
+        sink.on_message_abort();
+    }
+
+    flush_control_replies();
+    return received;
 }
 
 int ClientBase::available() {
+    const size_t view_size = view_end - view_begin;
     size_t frame_remain = in_frame_size - in_frame_pos;
 
+    if (view_size) {
+        // buffered data is payload of the current frame, more may follow
+        const size_t socket_available = frame_remain ? client.available() : 0;
+        return view_size + (frame_remain < socket_available ? frame_remain
+                                                            : socket_available);
+    }
+
     if (!frame_remain) {
         // no data left in current frame, let's see if another frame is
         // available
-        if (!await_data_frame()) {
+        if (reads_paused() || !await_data_frame()) {
             // no data frame received, give up
             return 0;
         }
@@ -351,9 +969,18 @@ int ClientBase::available() {
 }
 
 int ClientBase::read(uint8_t * buffer, size_t size) {
+    if (view_begin < view_end) {
+        // return data buffered by view() first
+        const size_t view_size = view_end - view_begin;
+        const size_t read_size = view_size < size ? view_size : size;
+        memcpy(buffer, view_buffer + view_begin, read_size);
+        consume(read_size);
+        return read_size;
+    }
+
     // TODO: Read data from multiple frames if available
     if (in_frame_pos >= in_frame_size) {
-        if (!await_data_frame()) {
+        if (reads_paused() || !await_data_frame()) {
             return 0;
         }
     }
@@ -363,7 +990,83 @@ int ClientBase::read(uint8_t * buffer, size_t size) {
     return read_payload(buffer, read_size);
 }
 
+const uint8_t * ClientBase::view(size_t & size) {
+    if (view_begin >= view_end) {
+        view_begin = view_end = 0;
+        if ((in_frame_pos >= in_frame_size) && reads_paused()) {
+            // give the idle buffer back to other connections
+            free_view_buffer();
+            size = 0;
+            return nullptr;
+        }
+        if ((in_frame_pos >= in_frame_size) && !await_data_frame()) {
+            size = 0;
+            return nullptr;
+        }
+    }
+
+    const size_t frame_remain = in_frame_size - in_frame_pos;
+    if (frame_remain && (view_end < PICOWEBSOCKET_VIEW_BUFFER_SIZE)) {
+        // more payload of the current frame may be waiting, top up the buffer
+        const size_t socket_available = client.available();
+        if (socket_available) {
+            if (!view_buffer) {
+                if (memory_budget &&
+                    !memory_budget->acquire(PICOWEBSOCKET_VIEW_BUFFER_SIZE)) {
+                    // no memory to spare, leave the data in the socket
+                    size = 0;
+                    return nullptr;
+                }
+                view_buffer = (uint8_t *)malloc(PICOWEBSOCKET_VIEW_BUFFER_SIZE);
+                if (!view_buffer) {
+                    if (memory_budget) {
+                        memory_budget->release(PICOWEBSOCKET_VIEW_BUFFER_SIZE);
+                    }
+                    size = 0;
+                    return nullptr;
+                }
+            }
+
+            if (view_begin) {
+                // make room at the end, the buffer is small so this is cheap
+                memmove(view_buffer, view_buffer + view_begin,
+                        view_end - view_begin);
+                view_end -= view_begin;
+                view_begin = 0;
+            }
+
+            size_t read_size = PICOWEBSOCKET_VIEW_BUFFER_SIZE - view_end;
+            if (read_size > frame_remain) {
+                read_size = frame_remain;
+            }
+            if (read_size > socket_available) {
+                read_size = socket_available;
+            }
+            view_end += read_payload(view_buffer + view_end, read_size);
+        }
+    }
+
+    size = view_end - view_begin;
+    return size ? view_buffer + view_begin : nullptr;
+}
+
+void ClientBase::consume(size_t size) {
+    const size_t view_size = view_end - view_begin;
+    view_begin += size < view_size ? size : view_size;
+
+    if ((view_begin == view_end) && memory_budget &&
+        memory_budget->under_pressure()) {
+        // buffer drained, give the memory back to other connections
+        view_begin = view_end = 0;
+        free_view_buffer();
+    }
+}
+
 int ClientBase::peek() {
+    if (view_begin < view_end) {
+        return view_buffer[view_begin];
+    }
+
     if (!available()) {
         // no payload data waiting in buffer
         return -1;
@@ -375,7 +1078,7 @@ int ClientBase::peek() {
 
     if (!is_client) {
         // we're the server, apply the mask
-        uint8_t * m = (uint8_t *)&mask;
+        uint8_t * m = (uint8_t *)&in_mask;
         c ^= m[in_frame_pos & 3];
     }
 
@@ -383,77 +1086,105 @@ int ClientBase::peek() {
 }
 
 String ClientBase::read_http_line(const unsigned long timeout_ms = 1000) {
-    const unsigned long start_time = millis();
+    const unsigned long start_time = clock_millis();
 
-    bool ending = false;
-
-    uint8_t buffer[PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH + 1];
-    size_t pos = 0;
+    String line;
+    unsigned int attempt = 0;
     while (true) {
-        if (pos >= PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH) {
-            // max line length reached
-            on_http_line_too_long();
+        const size_t length = line.length();
+        switch (poll_http_line(line)) {
+            case HttpLine::complete:
+                return line;
+            case HttpLine::error:
+                return "";
+            default:
+                break;
+        }
+
+        // no more data available
+        if (!client.connected()) {
+            // the client is disconnected, we won't get more data
             return "";
         }
 
+        const unsigned long elapsed_ms = clock_millis() - start_time;
+        if (elapsed_ms > timeout_ms) {
+            // time out reached
+            on_http_timeout();
+            return "";
+        }
+
+        if (line.length() != length) {
+            // progress was made, start waiting from scratch
+            attempt = 0;
+        }
+        wait_for_socket(WaitStrategy::Event::readable,
+                        timeout_ms - elapsed_ms, attempt++);
+    }
+}
+
+ClientBase::HttpLine ClientBase::poll_http_line(String & line) {
+    if (!line.length()) {
+        // allocate the line once instead of growing it character by character
+        line.reserve(PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH);
+    }
+
+    while (true) {
         const int c = client.read();
         if (c < 0) {
             // no more data available
-            if (!client.connected()) {
-                // the client is disconnected, we won't get more data
-                return "";
-            }
-
-            if (millis() - start_time > timeout_ms) {
-                // time out reached
-                on_http_timeout();
-                return "";
-            }
-
-            yield();
-            continue;
+            return HttpLine::incomplete;
         }
 
-        // got a valid char
-        if (ending) {
+        const size_t length = line.length();
+        if (length && (line[length - 1] == '\r')) {
             // we're waiting for the trailing \n, anything else is a protocol
             // violation
             if (c != '\n') {
                 PICOWEBSOCKET_DEBUG_PRINTF("Invalid HTTP line ending\n");
                 on_http_violation();
-                return "";
-            } else {
-                buffer[pos] = '\0';
-                PICOWEBSOCKET_DEBUG_PRINTF("HTTP line received: %s\n",
-                                           (const char *)buffer);
-                return (const char *)buffer;
+                return HttpLine::error;
             }
+            line.remove(length - 1);
+            PICOWEBSOCKET_DEBUG_PRINTF("HTTP line received: %s\n",
+                                       line.c_str());
+            return HttpLine::complete;
+        }
+
+        if (c == '\r') {
+            // end of line found, wait for the \n now
+            line += '\r';
+        } else if (c < 0x20 || c == 0x7f) {
+            // control character
+            PICOWEBSOCKET_DEBUG_PRINTF("Illegal HTTP line character\n");
+            on_http_violation();
+            return HttpLine::error;
+        } else if (length + 1 >= PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH) {
+            // max line length reached
+            on_http_line_too_long();
+            return HttpLine::error;
         } else {
-            if (c == '\r') {
-                // end of line found, wait for the \n now
-                ending = true;
-            } else if (c < 0x20 || c == 0x7f) {
-                // control character
-                PICOWEBSOCKET_DEBUG_PRINTF("Illegal HTTP line character\n");
-                on_http_violation();
-                return "";
-            } else {
-                buffer[pos++] = (uint8_t)c;
-            }
+            line += (char)c;
         }
     }
 }
 
 void ClientBase::discard_incoming_data() {
     PICOWEBSOCKET_DEBUG_PRINTF("Discarding remaining received data\n");
+    // read in chunks, just like discard_payload()
+    uint8_t buffer[128];
     while (client.available()) {
-        client.read();
+        if (client.read(buffer, sizeof(buffer)) <= 0) {
+            break;
+        }
     }
 }
 
-void ClientBase::on_violation() {
+void ClientBase::on_violation(const uint16_t code) {
     PICOWEBSOCKET_DEBUG_PRINTF("Websocket protocol violation\n");
-    close(1002);
+    // NOTE: In split mode the close frame is only queued, it will most likely
+    // not make it before the connection is dropped.
+    reply_close(code, false);
     // After a close frame we should wait for a close reply, but since we've
     // encountered a protocol violation, we give up the connection right away.
     discard_incoming_data();
@@ -461,12 +1192,17 @@ void ClientBase::on_violation() {
 }
 
 std::pair<String, String> ClientBase::read_http_header() {
-    String request = read_http_line(socket_timeout_ms);
+    const String request = read_http_line(socket_timeout_ms);
 
     if (request == "") {
         return {"", ""};
     }
 
+    return parse_http_header(request);
+}
+
+std::pair<String, String> ClientBase::parse_http_header(
+    const String & request) {
     const int colon_idx = request.indexOf(':');
     if (colon_idx < 0) {
         PICOWEBSOCKET_DEBUG_PRINTF("Malformed HTTP header: colon missing\n");
@@ -488,13 +1224,13 @@ std::pair<String, String> ClientBase::read_http_header() {
     return std::make_pair(name, value);
 }
 
-void ClientBase::write_head(Opcode opcode, bool fin, size_t payload_length) {
-    uint8_t buffer[14];
+size_t ClientBase::encode_head(uint8_t * buffer, Opcode opcode, bool fin,
+                               size_t payload_length, bool masked) {
     uint8_t * pos = buffer;
 
     *pos++ = (opcode & 0x0f) | (fin ? 1 << 7 : 0);
 
-    const uint8_t mask_bit = (is_client ? 1 << 7 : 0);
+    const uint8_t mask_bit = (masked ? 1 << 7 : 0);
 
     if (payload_length <= 125) {
         *pos++ = uint8_t(payload_length) | mask_bit;
@@ -514,16 +1250,28 @@ void ClientBase::write_head(Opcode opcode, bool fin, size_t payload_length) {
         *pos++ = (payload_length >> 0) & 0xff;
     }
 
+    return pos - buffer;
+}
+
+void ClientBase::write_head(Opcode opcode, bool fin, size_t payload_length) {
+    uint8_t buffer[14];
+    uint8_t * pos =
+        buffer + encode_head(buffer, opcode, fin, payload_length, is_client);
+
     if (is_client) {
-        mask = (uint32_t)random();
+        out_mask = (uint32_t)random();
         // write mask as is, don't convert since it's already in big endian
-        memcpy(pos, &mask, 4);
+        memcpy(pos, &out_mask, 4);
         pos += 4;
     }
 
     PICOWEBSOCKET_DEBUG_PRINTF(
         "Frame send: opcode=%1x fin=%i len=%u mask_key=%08x\n", opcode, fin,
-        payload_length, is_client ? mask : 0);
+        payload_length, is_client ? out_mask : 0);
+
+    if (tap) {
+        tap->on_frame_head(true, opcode, fin, payload_length);
+    }
 
     write_all(buffer, pos - buffer);
 }
@@ -531,7 +1279,13 @@ void ClientBase::write_head(Opcode opcode, bool fin, size_t payload_length) {
 ClientBase::Opcode ClientBase::read_head() {
     uint8_t head[14];
 
-    if (!read_all(head, 2, socket_timeout_ms)) {
+    // the start of the header may have been read already by poll_close()
+    const size_t head_start_missing = 2 - head_start_size;
+    memcpy(head, head_start, head_start_size);
+    head_start_size = 0;
+    if (head_start_missing &&
+        !read_all(head + 2 - head_start_missing, head_start_missing,
+                  socket_timeout_ms)) {
         PICOWEBSOCKET_DEBUG_PRINTF("Error reading first 2 header bytes.\n");
         return Opcode::ERR;
     }
@@ -565,15 +1319,21 @@ ClientBase::Opcode ClientBase::read_head() {
 
     if (has_mask) {
         // mask is stored in big endian, no need to invert
-        memcpy(&mask, pos, 4);
+        memcpy(&in_mask, pos, 4);
     }
 
     in_frame_pos = 0;
     in_frame_size = payload_length;
+    in_frame_fin = fin;
+    last_received_ms = clock_millis();
 
     PICOWEBSOCKET_DEBUG_PRINTF(
         "Frame recv: opcode=%1x fin=%i len=%llu mask_key=%08x\n", opcode, fin,
-        payload_length, is_client ? 0 : mask);
+        payload_length, is_client ? 0 : in_mask);
+
+    if (tap) {
+        tap->on_frame_head(false, opcode, fin, (size_t)payload_length);
+    }
 
     // Frame header is now received successfully, run a simple check
     // to see if it conforms to the RFC.
@@ -599,32 +1359,62 @@ ClientBase::Opcode ClientBase::read_head() {
 
     if (payload_length > std::numeric_limits<size_t>::max()) {
         PICOWEBSOCKET_DEBUG_PRINTF("Received message too big\n");
-        stop();
+        on_violation(1009);
         return Opcode::ERR;
     }
 
+    if (!((uint8_t)(opcode) & 0x8)) {
+        // data frame, check the limits before any payload is read
+        const size_t frame_size = payload_length;
+        if (opcode != Opcode::DATA_CONTINUATION) {
+            in_message_size = 0;
+        }
+        in_message_size =
+            (frame_size > std::numeric_limits<size_t>::max() - in_message_size)
+                ? std::numeric_limits<size_t>::max()
+                : in_message_size + frame_size;
+
+        if ((max_incoming_frame_size &&
+             (frame_size > max_incoming_frame_size)) ||
+            (max_incoming_message_size &&
+             (in_message_size > max_incoming_message_size))) {
+            PICOWEBSOCKET_DEBUG_PRINTF("Received frame or message too big\n");
+            on_violation(1009);
+            return Opcode::ERR;
+        }
+    }
+
     return opcode;
 }
 
 int Client::connect(IPAddress ip, uint16_t port) {
+    start_timing();
     return (client.connect(ip, port) && handshake(ip.toString())) ? 1 : 0;
 }
 
 int Client::connect(const char * host, uint16_t port) {
+    start_timing();
     return (client.connect(host, port) && handshake(host)) ? 1 : 0;
 }
 
 #ifdef PICOWEBSOCKET_EXTRA_CONNECT_METHODS
 int Client::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    start_timing();
     return (client.connect(ip, port, timeout) && handshake(ip.toString())) ? 1
                                                                            : 0;
 }
 
 int Client::connect(const char * host, uint16_t port, int32_t timeout) {
+    start_timing();
     return (client.connect(host, port, timeout) && handshake(host)) ? 1 : 0;
 }
 #endif
 
+void Client::start_timing() {
+    timing = Timing();
+    connect_start_us = clock_micros();
+}
+
 void Client::on_http_error() {
     PICOWEBSOCKET_DEBUG_PRINTF("HTTP protocol error\n");
     discard_incoming_data();
@@ -641,24 +1431,63 @@ void Client::on_http_violation() {
 }
 
 bool Client::handshake(const String & host) {
+    timing.tcp_connected = elapsed_us();
+    const String sec_websocket_key = send_handshake_request(host);
+    timing.request_sent = elapsed_us();
+    return read_handshake_response(sec_websocket_key);
+}
+
+String Client::send_handshake_request(const String & host) {
     const String sec_websocket_key = gen_key();
 
-    client.printf(
-        "GET %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
+    // Render the whole request first and send it with a single write.  Every
+    // write can end up in a separate TCP segment (or TLS record).
+    String request;
+    request.reserve(160 + path.length() + host.length() + protocol.length());
+    request += "GET ";
+    request += path;
+    request += " HTTP/1.1\r\nHost: ";
+    request += host;
+    request +=
+        "\r\n"
         "Connection: Upgrade\r\n"
         "Upgrade: websocket\r\n"
-        "Sec-WebSocket-Key: %s\r\n"
-        "Sec-WebSocket-Version: 13\r\n",
-        path.c_str(), host.c_str(), sec_websocket_key.c_str());
+        "Sec-WebSocket-Key: ";
+    request += sec_websocket_key;
+    request += "\r\nSec-WebSocket-Version: 13\r\n";
 
     if (protocol.length()) {
-        client.printf("Sec-WebSocket-Protocol: %s\r\n", protocol.c_str());
+        request += "Sec-WebSocket-Protocol: ";
+        request += protocol;
+        request += "\r\n";
+    }
+
+    request += "\r\n";
+
+    write_all(request.c_str(), request.length());
+
+    return sec_websocket_key;
+}
+
+bool Client::read_handshake_response(const String & sec_websocket_key) {
+    if (!check_response_status(read_http_line())) {
+        return false;
+    }
+
+    HandshakeResponse response = {false, false, false, false};
+
+    while (true) {
+        const auto header = read_http_header();
+        if (header.first == "") {
+            break;
+        }
+        check_response_header(header, sec_websocket_key, response);
     }
 
-    client.print("\r\n");
+    return check_response(response);
+}
 
-    const String response = read_http_line();
+bool Client::check_response_status(const String & response) {
     const int code_start = response.indexOf(' ');
     const int code_end = response.indexOf(' ', code_start + 1);
     if (code_start < 0 || code_end < 0) {
@@ -668,6 +1497,8 @@ bool Client::handshake(const String & host) {
         return false;
     }
 
+    timing.response_received = elapsed_us();
+
     const String version = response.substring(0, code_start);
     const unsigned int code =
         response.substring(code_start + 1, code_end).toInt();
@@ -685,34 +1516,33 @@ bool Client::handshake(const String & host) {
         return false;
     }
 
-    bool connection_upgrade = false;
-    bool upgrade_websocket = false;
-    bool sec_websocket_protocol = (protocol.length() == 0);
-    bool sec_websocket_accept = false;
-
-    while (true) {
-        auto header = read_http_header();
+    return true;
+}
 
-        if (header.first == "") {
-            break;
-        } else if (header.first == "connection") {
-            header.second.toLowerCase();
-            connection_upgrade = (header.second == "upgrade");
-        } else if (header.first == "upgrade") {
-            header.second.toLowerCase();
-            upgrade_websocket = (header.second == "websocket");
-        } else if (header.first == "sec-websocket-accept") {
-            sec_websocket_accept =
-                (header.second == calc_key(sec_websocket_key));
-        } else if (header.first == "sec-websocket-protocol") {
-            sec_websocket_protocol =
-                sec_websocket_protocol ||
-                (get_subprotocol(header.second, protocol) == protocol);
-        }
+void Client::check_response_header(const std::pair<String, String> & header,
+                                   const String & sec_websocket_key,
+                                   HandshakeResponse & response) {
+    String value = header.second;
+    if (header.first == "connection") {
+        value.toLowerCase();
+        response.connection_upgrade = (value == "upgrade");
+    } else if (header.first == "upgrade") {
+        value.toLowerCase();
+        response.upgrade_websocket = (value == "websocket");
+    } else if (header.first == "sec-websocket-accept") {
+        response.sec_websocket_accept = (value == calc_key(sec_websocket_key));
+    } else if (header.first == "sec-websocket-protocol") {
+        response.sec_websocket_protocol =
+            response.sec_websocket_protocol ||
+            (get_subprotocol(value, protocol) == protocol);
     }
+}
 
-    const bool all_ok = connection_upgrade && upgrade_websocket &&
-                        sec_websocket_protocol && sec_websocket_accept;
+bool Client::check_response(const HandshakeResponse & response) {
+    const bool all_ok =
+        response.connection_upgrade && response.upgrade_websocket &&
+        (response.sec_websocket_protocol || (protocol.length() == 0)) &&
+        response.sec_websocket_accept;
 
     if (!all_ok) {
         // we didn't get (some) of the expected headers
@@ -721,15 +1551,147 @@ bool Client::handshake(const String & host) {
     }
 
     // The websocket connection is all set up now.
-    PICOWEBSOCKET_DEBUG_PRINTF("Handshake complete\n");
+    timing.handshake_complete = elapsed_us();
+    PICOWEBSOCKET_DEBUG_PRINTF("Handshake complete in %lu us\n",
+                               timing.handshake_complete);
 
     return true;
 }
 
+void Client::start_connect(const char * host, uint16_t port,
+                           unsigned long timeout_ms) {
+    connect_host = host;
+    connect_use_ip = false;
+    connect_port = port;
+    connect_timeout_ms = timeout_ms;
+    connect_start_ms = clock_millis();
+    start_timing();
+    set_connect_state(ConnectState::connecting);
+}
+
+void Client::start_connect(IPAddress ip, uint16_t port,
+                           unsigned long timeout_ms) {
+    start_connect(ip.toString().c_str(), port, timeout_ms);
+    connect_ip = ip;
+    connect_use_ip = true;
+}
+
+void Client::set_connect_state(ConnectState state) {
+    connect_state = state;
+    on_connect_state(state);
+}
+
+void Client::fail_connect() {
+    PICOWEBSOCKET_DEBUG_PRINTF("Non-blocking connect failed\n");
+    client.stop();
+    connect_key = connect_line = "";
+    set_connect_state(ConnectState::failed);
+}
+
+Client::ConnectState Client::poll_connect() {
+    switch (connect_state) {
+        case ConnectState::idle:
+        case ConnectState::open:
+        case ConnectState::failed:
+            return connect_state;
+        default:
+            break;
+    }
+
+    if (clock_millis() - connect_start_ms > connect_timeout_ms) {
+        PICOWEBSOCKET_DEBUG_PRINTF("Connect timed out\n");
+        fail_connect();
+        return connect_state;
+    }
+
+    switch (connect_state) {
+        case ConnectState::connecting: {
+#ifdef PICOWEBSOCKET_EXTRA_CONNECT_METHODS
+            // don't let the TCP connect overrun the deadline
+            const int32_t timeout =
+                connect_timeout_ms - (clock_millis() - connect_start_ms);
+            const bool connected =
+                client.connected() ||
+                (connect_use_ip
+                     ? client.connect(connect_ip, connect_port, timeout)
+                     : client.connect(connect_host.c_str(), connect_port,
+                                      timeout));
+#else
+            const bool connected =
+                client.connected() ||
+                (connect_use_ip
+                     ? client.connect(connect_ip, connect_port)
+                     : client.connect(connect_host.c_str(), connect_port));
+#endif
+            if (!connected) {
+                fail_connect();
+                break;
+            }
+            timing.tcp_connected = elapsed_us();
+            set_connect_state(ConnectState::tcp_connected);
+            break;
+        }
+
+        case ConnectState::tcp_connected: {
+            connect_key = send_handshake_request(connect_host);
+            timing.request_sent = elapsed_us();
+            connect_line = "";
+            connect_response = {false, false, false, false};
+            set_connect_state(ConnectState::request_sent);
+            break;
+        }
+
+        default: {
+            // request_sent or response_parsed, process all complete lines
+            while (connect_state != ConnectState::open) {
+                const HttpLine result = poll_http_line(connect_line);
+                if (result == HttpLine::error) {
+                    fail_connect();
+                    break;
+                } else if (result == HttpLine::incomplete) {
+                    if (!client.connected()) {
+                        fail_connect();
+                    }
+                    break;
+                }
+
+                const String line = connect_line;
+                connect_line = "";
+
+                if (connect_state == ConnectState::request_sent) {
+                    if (!check_response_status(line)) {
+                        fail_connect();
+                        break;
+                    }
+                    set_connect_state(ConnectState::response_parsed);
+                } else if (line.length()) {
+                    const auto header = parse_http_header(line);
+                    if (header.first == "") {
+                        fail_connect();
+                        break;
+                    }
+                    check_response_header(header, connect_key,
+                                          connect_response);
+                } else if (check_response(connect_response)) {
+                    connect_key = "";
+                    set_connect_state(ConnectState::open);
+                } else {
+                    fail_connect();
+                    break;
+                }
+            }
+            break;
+        }
+    }
+
+    return connect_state;
+}
+
 void ServerClient::on_http_error(const unsigned short code,
                                  const String & message) {
     PICOWEBSOCKET_DEBUG_PRINTF("HTTP protocol error %u %s\n", code,
                                message.c_str());
+    timeout.cancel();
     discard_incoming_data();
     client.printf(
         "HTTP/1.1 %u %s\r\n"
@@ -751,7 +1713,174 @@ void ServerClient::on_http_violation() {
     on_http_error(400, F("Protocol Violation"));
 }
 
+void ServerClient::start_idle_timeout() {
+    timeout_phase = TimeoutPhase::idle;
+    if (!timers || !server.idle_timeout_ms) {
+        timeout.cancel();
+        return;
+    }
+    timeout.schedule(*timers, server.idle_timeout_ms);
+}
+
+void ServerClient::set_timers(TimerWheel * wheel) {
+    timeout.cancel();
+    timers = wheel;
+    if (!timers || !client.connected()) {
+        return;
+    }
+    if (timeout_phase == TimeoutPhase::idle) {
+        start_idle_timeout();
+    } else {
+        timeout.schedule(*timers, socket_timeout_ms);
+    }
+}
+
+void ServerClient::on_timeout() {
+    if (!client.connected()) {
+        return;
+    }
+
+    if ((timeout_phase == TimeoutPhase::idle) && !closing) {
+        const unsigned long idle_ms = clock_millis() - last_received_ms;
+        if (idle_ms < server.idle_timeout_ms) {
+            // Data was received since the timer was set.  Instead of
+            // rescheduling the timer on every read, we check it here.
+            timeout.schedule(*timers, server.idle_timeout_ms - idle_ms);
+            return;
+        }
+
+        PICOWEBSOCKET_DEBUG_PRINTF("Idle timeout\n");
+        // in split mode, only the writer may send the close frame
+        begin_close(1001);
+        timeout_phase = TimeoutPhase::close_wait;
+        timeout.schedule(*timers, socket_timeout_ms);
+        return;
+    }
+
+    // handshake or close handshake not completed in time
+    PICOWEBSOCKET_DEBUG_PRINTF("Timeout, dropping connection\n");
+    client.stop();
+}
+
+bool ServerInterface::admit_connection() {
+    bool ok = !(max_connections && (connections >= max_connections)) &&
+              !(max_pending_handshakes &&
+                (pending_handshakes >= max_pending_handshakes));
+
+    if (ok && accept_rate) {
+        // refill the token bucket
+        const unsigned long capacity =
+            (accept_burst ? accept_burst : 1) * 1000ul;
+        const unsigned long now = clock_millis();
+        const unsigned long elapsed_ms = now - accept_refill_ms;
+        accept_refill_ms = now;
+        if ((accept_tokens >= capacity) ||
+            (elapsed_ms >= capacity / accept_rate)) {
+            accept_tokens = capacity;
+        } else {
+            accept_tokens += elapsed_ms * accept_rate;
+            if (accept_tokens > capacity) {
+                accept_tokens = capacity;
+            }
+        }
+
+        if (accept_tokens >= 1000) {
+            accept_tokens -= 1000;
+        } else {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        ++rejected;
+    }
+
+    return ok;
+}
+
+ServerClient::~ServerClient() {
+    end_pending_handshake();
+    if (admission == Admission::open) {
+        --server.connections;
+    }
+}
+
+bool ServerClient::admit() {
+    if (!server.admit_connection()) {
+        PICOWEBSOCKET_DEBUG_PRINTF("Connection not admitted\n");
+        timeout.cancel();
+        if (!server.reject_silently) {
+            static const char response[] =
+                "HTTP/1.1 503 Service Unavailable\r\n"
+                "Content-Length: 0\r\n\r\n";
+            client.write((const uint8_t *)response, sizeof(response) - 1);
+        }
+        client.stop();
+        return false;
+    }
+
+    admission = Admission::pending;
+    ++server.connections;
+    ++server.pending_handshakes;
+    if (timers) {
+        timeout.schedule(*timers, socket_timeout_ms);
+    }
+    return true;
+}
+
+void ServerClient::end_pending_handshake() {
+    if (admission != Admission::pending) {
+        return;
+    }
+
+    --server.pending_handshakes;
+    if (client.connected()) {
+        admission = Admission::open;
+    } else {
+        // handshake failed
+        admission = Admission::none;
+        --server.connections;
+    }
+}
+
+void ServerClient::copy_admission(const ServerClient & other) {
+    admission = other.admission;
+    if (admission != Admission::none) {
+        ++server.connections;
+    }
+    if (admission == Admission::pending) {
+        ++server.pending_handshakes;
+    }
+}
+
+bool ServerClient::dispatch() {
+    if (!available()) {
+        return false;
+    }
+    endpoint->on_message(*this);
+    return true;
+}
+
 void ServerClient::handshake() {
+    if ((admission == Admission::none) && !admit()) {
+        return;
+    }
+    handshake_request();
+    end_pending_handshake();
+}
+
+void ServerClient::handshake_request() {
+    // The handshake allocates a few strings, don't start it if there's not
+    // enough memory.
+    const MemoryReservation reservation(
+        server.memory_budget,
+        server.memory_budget ? server.memory_budget->handshake_reserve : 0);
+    if (!reservation.ok) {
+        PICOWEBSOCKET_DEBUG_PRINTF("Memory budget exhausted\n");
+        on_http_error(503, F("Service Unavailable"));
+        return;
+    }
+
     // handle handshake
     const String request = read_http_line();
     if (request == "") {
@@ -784,8 +1913,10 @@ void ServerClient::handshake() {
         return;
     }
 
-    if (!server.check_url(url)) {
+    endpoint = server.resolve(url);
+    if (!endpoint) {
         PICOWEBSOCKET_DEBUG_PRINTF("URL rejected: %s\n", url.c_str());
+        endpoint = &server;
         on_http_error(404, F("Not found"));
         return;
     }
@@ -793,7 +1924,7 @@ void ServerClient::handshake() {
     // Process headers
     String sec_websocket_key;
     String sec_websocket_protocol;
-    bool sec_websocket_protocol_ok = (server.protocol.length() == 0);
+    bool sec_websocket_protocol_ok = (endpoint->protocol.length() == 0);
     bool connection_upgrade = false;
     bool upgrade_websocket = false;
     bool headers_ok = true;
@@ -801,8 +1932,8 @@ void ServerClient::handshake() {
     while (true) {
         auto header = read_http_header();
 
-        headers_ok =
-            headers_ok && server.check_http_header(header.first, header.second);
+        headers_ok = headers_ok &&
+                     endpoint->check_http_header(header.first, header.second);
 
         if (header.first == "") {
             break;
@@ -816,10 +1947,10 @@ void ServerClient::handshake() {
             sec_websocket_key = header.second;
         } else if (header.first == "sec-websocket-protocol") {
             sec_websocket_protocol =
-                get_subprotocol(header.second, server.protocol);
+                get_subprotocol(header.second, endpoint->protocol);
             sec_websocket_protocol_ok =
                 sec_websocket_protocol_ok ||
-                (sec_websocket_protocol == server.protocol);
+                (sec_websocket_protocol == endpoint->protocol);
         }
     }
 
@@ -832,20 +1963,28 @@ void ServerClient::handshake() {
         return;
     }
 
-    // All looks good, accept connection upgrade
-    client.printf(
+    // All looks good, accept connection upgrade.  The response is sent with a
+    // single write.
+    String response;
+    response.reserve(160 + sec_websocket_protocol.length());
+    response +=
         "HTTP/1.1 101 Switching Protocols\r\n"
         "Upgrade: websocket\r\n"
         "Connection: Upgrade\r\n"
-        "Sec-WebSocket-Accept: %s\r\n",
-        calc_key(sec_websocket_key).c_str());
+        "Sec-WebSocket-Accept: ";
+    response += calc_key(sec_websocket_key);
+    response += "\r\n";
 
     if (sec_websocket_protocol.length() > 0) {
-        client.printf("Sec-WebSocket-Protocol: %s\r\n",
-                      sec_websocket_protocol.c_str());
+        response += "Sec-WebSocket-Protocol: ";
+        response += sec_websocket_protocol;
+        response += "\r\n";
     }
 
-    client.print("\r\n");
+    response += "\r\n";
+
+    write_all(response.c_str(), response.length());
+    start_idle_timeout();
 
     // The websocket connection is all set up now.
     PICOWEBSOCKET_DEBUG_PRINTF("Handshake complete\n");
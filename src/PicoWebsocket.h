@@ -3,10 +3,33 @@
 #include <Arduino.h>
 #include <Client.h>
 
+#include <atomic>
+#include <climits>
+
+#include "PicoWebsocketClock.h"
+#include "PicoWebsocketTimer.h"
+#include "PicoWebsocketWait.h"
+
 #ifndef PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH
 #define PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH 128
 #endif
 
+#ifndef PICOWEBSOCKET_SINK_CHUNK_SIZE
+#define PICOWEBSOCKET_SINK_CHUNK_SIZE 128
+#endif
+
+#ifndef PICOWEBSOCKET_VIEW_BUFFER_SIZE
+#define PICOWEBSOCKET_VIEW_BUFFER_SIZE 256
+#endif
+
+#ifndef PICOWEBSOCKET_ADAPTIVE_FRAME_SIZE_LIMIT
+#define PICOWEBSOCKET_ADAPTIVE_FRAME_SIZE_LIMIT 16384
+#endif
+
+#ifndef PICOWEBSOCKET_RELAY_CHUNK_SIZE
+#define PICOWEBSOCKET_RELAY_CHUNK_SIZE 256
+#endif
+
 #ifdef ESP32
 // Uncomment this define to make PicoMQTT compatible with framework variants
 // which have extra Client::connect methods which accept a timeout parameter.
@@ -15,6 +38,43 @@
 
 namespace PicoWebsocket {
 
+class MemoryBudget;
+
+// Consumer of incoming messages, see ClientBase::receive().  Payload is pushed
+// to the sink in chunks as it arrives, so messages of any size can be handled
+// with constant memory.
+class MessageSink {
+public:
+    virtual ~MessageSink() {}
+
+    // A new message starts.  If fragmented is false, length is the size of the
+    // whole message, otherwise it's the size of the first fragment only and
+    // the total size is not known upfront.
+    virtual void on_message_begin(bool bin, size_t length, bool fragmented) {}
+
+    // Next chunk of payload data.  Return false to reject the message, this
+    // starts closing the connection (see ClientBase::begin_close()).
+    virtual bool on_message_data(const void * data, size_t size) = 0;
+
+    // Whole message received.
+    virtual void on_message_end() {}
+
+    // Message rejected or connection lost before the message was complete.
+    virtual void on_message_abort() {}
+};
+
+// Observer of the frames sent and received by a connection, used for traffic
+// capture (see PicoWebsocketCapture.h).  Payload is always reported unmasked.
+class FrameTap {
+public:
+    virtual ~FrameTap() {}
+
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) = 0;
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) = 0;
+};
+
 class ClientBase : public ::Client {
 public:
     size_t write(const void * buffer, size_t size, bool fin, bool bin = true);
@@ -31,9 +91,41 @@ public:
     }
     virtual int peek() override;
 
-    virtual void flush() override { client.flush(); }
+    // Zero-copy reading.  view() returns a pointer to received and unmasked
+    // payload data held in an internal buffer and sets size to the number of
+    // bytes available there.  The data stays valid until it's consumed using
+    // consume(n), so it can be inspected or forwarded in place.  Returns
+    // nullptr (and size 0) if no payload data is available.  The view never
+    // spans multiple frames.
+    // NOTE: The internal buffer is allocated on the first call.
+    const uint8_t * view(size_t & size);
+    void consume(size_t size);
+
+    // Drop the rest of the current frame or message, waiting for the data to
+    // arrive if needed.  The data is discarded in bulk, without unmasking.
+    // Return false if the connection was lost or timed out.
+    bool skip_frame();
+    bool skip_message();
+
+    virtual ~ClientBase();
+    ClientBase(const ClientBase &) = delete;
+    ClientBase & operator=(const ClientBase &) = delete;
+
+    virtual void flush() override {
+        flush_control_replies();
+        client.flush();
+    }
     virtual void stop() override;
 
+    // Non-blocking close.  begin_close() sends a close frame, poll_close()
+    // then processes the data which has arrived so far without waiting:
+    // data frames are discarded in bulk until the peer's close reply
+    // arrives.  Returns true once the connection is closed.  abort() drops
+    // the connection right away.
+    void begin_close(uint16_t code = 1000);
+    bool poll_close();
+    void abort() { client.stop(); }
+
     virtual uint8_t connected() override { return client.connected(); }
 
     virtual operator bool() { return bool(client); }
@@ -41,8 +133,61 @@ public:
     void ping(const void * payload = nullptr, size_t size = 0);
     void pong(const void * payload = nullptr, size_t size = 0);
 
+    // Push incoming data to sink, without blocking.  Only data which is
+    // already available is processed, so this should be called periodically.
+    // Returns the number of payload bytes passed to the sink.  Once the
+    // connection is closing, calls just drive poll_close().
+    // NOTE: Don't mix this with read() and friends on the same connection.
+    size_t receive(MessageSink & sink);
+
     unsigned long socket_timeout_ms;
 
+    // Maximum payload size of outgoing frames, 0 means no limit.  Larger
+    // writes are split into fragments and incoming control frames (pings,
+    // close) are handled in between, so that replies are not delayed until
+    // the whole message is sent.
+    size_t max_frame_size;
+
+    // Adaptive fragmentation.  When enabled, writes are split into frames
+    // sized after what the transport accepts: the size doubles after a few
+    // frames which client.write() took without waiting and shrinks when a
+    // frame has to wait for the send buffer repeatedly.  The size stays
+    // between min_frame_size and max_frame_size (or
+    // PICOWEBSOCKET_ADAPTIVE_FRAME_SIZE_LIMIT if max_frame_size is 0).
+    bool adaptive_framing;
+    size_t min_frame_size;
+    size_t get_adaptive_frame_size() const { return adaptive_frame_size; }
+
+    // Optional budget for memory allocated by the connection, see
+    // PicoWebsocketMemory.h.  When the budget is exhausted, view() returns no
+    // data until memory is released.  While the budget is under pressure, no
+    // new messages are read.
+    MemoryBudget * memory_budget;
+
+    // Limits on the payload size of incoming data frames and of reassembled
+    // messages, 0 means no limit.  They are checked as soon as a frame header
+    // arrives; if exceeded, the connection is closed with code 1009 without
+    // reading the payload.
+    size_t max_incoming_frame_size;
+    size_t max_incoming_message_size;
+
+    // Optional observer of all frames, nullptr disables it.
+    FrameTap * tap;
+
+    // How blocking operations wait for the socket, nullptr means yield().
+    WaitStrategy * wait_strategy;
+
+    // If set, pings are not answered one by one.  The pong is sent once all
+    // the data available has been processed (or before the next frame is
+    // written) and carries the payload of the most recent ping, as allowed
+    // by RFC 6455.  A burst of pings is then answered by a single pong.
+    // Disabled by default.
+    bool coalesce_pongs;
+
+    // Maximum number of pings and pongs accepted per second, 0 means no
+    // limit.  Peers exceeding it are disconnected with code 1008.
+    unsigned int max_control_frame_rate;
+
 protected:
     ClientBase(::Client & client, unsigned long socket_timeout_ms = 1000,
                bool is_client = true);
@@ -65,17 +210,41 @@ protected:
     virtual void on_http_violation() = 0;
     String read_http_line(const unsigned long timeout_ms);
     std::pair<String, String> read_http_header();
+    std::pair<String, String> parse_http_header(const String & line);
+
+    // Non-blocking line reading, appends the data available on the client to
+    // line.  On error, the appropriate on_http_*() handler is called.
+    enum class HttpLine : uint8_t { incomplete, complete, error };
+    HttpLine poll_http_line(String & line);
 
     void discard_incoming_data();
-    void on_violation();
+    size_t discard_payload(const size_t size);
+    void free_view_buffer();
+    void on_violation(const uint16_t code = 1002);
 
+    bool reads_paused();
     bool await_data_frame();
+    void handle_control_frame(const Opcode opcode);
+    void handle_pending_control_frames();
 
+    // Render a frame header without the mask key into buffer (at least 10
+    // bytes), returns its size.
+    static size_t encode_head(uint8_t * buffer, Opcode opcode, bool fin,
+                              size_t payload_length, bool masked);
     void write_head(Opcode opcode, bool fin, size_t payload_length);
     Opcode read_head();
 
     size_t write_frame(Opcode opcode, bool fin, const void * payload,
                        size_t size);
+    // Send a complete, unmasked frame rendered in advance, so that the same
+    // buffer can be sent to many connections.  Server side only.
+    size_t write_encoded_frame(const uint8_t * frame, size_t head_size,
+                               size_t payload_size);
+
+    // XOR data with a mask key (in big endian), offset is the position of
+    // data in the frame payload.
+    static void mask_payload(void * data, uint32_t mask, size_t size,
+                             size_t offset = 0);
 
     size_t read_payload(void * buffer, const size_t size,
                         const bool all = false);
@@ -85,22 +254,102 @@ protected:
                     const unsigned long timeout_ms);
     size_t write_all(const void * buffer, const size_t size);
 
+    void wait_for_socket(WaitStrategy::Event event, unsigned long timeout_ms,
+                         unsigned int attempt);
+
+    size_t next_frame_size(size_t remaining);
+    void update_adaptive_frame_size(size_t frame_size);
+
     void close(const uint16_t code = 0);
     void stop(uint16_t code);
 
+    // Replies sent from the read path.  In split mode they are queued and
+    // sent by the writer (see send_control_replies()).
+    void reply_pong(const void * payload, size_t size);
+    void reply_close(uint16_t code, bool disconnect);
+    void send_control_replies();
+
+    // Send the coalesced pong, if any.  Does nothing in split mode, where
+    // replies are sent by the writer.
+    void flush_control_replies();
+
+    // Count an incoming ping or pong, returns false if the rate limit is
+    // exceeded.
+    bool check_control_frame_rate();
+
     ::Client & client;
     const bool is_client;
 
-    // NOTE: The mask is stored in big endian -- this simplifies the masking and
-    // unmasking operations a bit.
-    uint32_t mask;
+    // NOTE: The masks are stored in big endian -- this simplifies the masking
+    // and unmasking operations a bit.  Incoming and outgoing frames use
+    // separate masks, so that the read and write paths don't share state.
+    uint32_t in_mask;
+    uint32_t out_mask;
 
     size_t in_frame_size;
     size_t in_frame_pos;
+    bool in_frame_fin;
+
+    // start of a frame header read ahead by poll_close(), read_head() picks
+    // it up
+    uint8_t head_start[2];
+    uint8_t head_start_size;
+
+    // payload size of the incoming message received so far
+    size_t in_message_size;
+
+    // millis() when data was last received
+    unsigned long last_received_ms;
+
+    // Adaptive fragmentation state: the current frame size, the number of
+    // times the current frame had to wait for the send buffer and the number
+    // of full sized frames sent without waiting.
+    size_t adaptive_frame_size;
+    size_t write_waits;
+    uint8_t clean_frames;
 
     // state
+    bool in_message;
     bool write_continue;
-    bool closing;
+    std::atomic<bool> closing;
+
+    // receive() state
+    bool sink_message;
+    bool sink_message_fin;
+
+    // view() buffer, holds unmasked payload which was not consumed yet
+    uint8_t * view_buffer;
+    size_t view_begin;
+    size_t view_end;
+
+    // control frame rate limiting, start of the current 1 second window and
+    // the number of control frames received in it
+    unsigned long control_window_ms;
+    unsigned int control_frame_count;
+
+    // Control frame replies queued by the reader in split mode (see
+    // PicoWebsocketSplit.h) or when pongs are coalesced.  Only the reply to
+    // the most recent ping is kept.
+    enum PongState : uint8_t {
+        PONG_NONE,
+        PONG_WRITING,
+        PONG_READY,
+        PONG_SENDING,
+    };
+    bool split_mode;
+    std::atomic<uint8_t> pong_state;
+    uint8_t pong_size;
+    uint8_t pong_payload[125];
+    // close code to send, with bit 16 set if the connection should be
+    // dropped afterwards, -1 if there's none
+    std::atomic<int32_t> pending_close;
+
+    friend class MessageQueue;
+    friend class ReadHalf;
+    friend class WriteHalf;
+    friend class PubSub;
+    friend class Relay;
+    friend class ServerInterface;
 };
 
 class Client : public ClientBase {
@@ -109,7 +358,16 @@ public:
            const String & protocol = "", unsigned long socket_timeout_ms = 1000)
         : ClientBase(client, socket_timeout_ms, true),
           path(path),
-          protocol(protocol) {}
+          protocol(protocol),
+          timing(),
+          connect_start_us(0),
+          connect_state(ConnectState::idle),
+          connect_ip(),
+          connect_use_ip(false),
+          connect_port(0),
+          connect_start_ms(0),
+          connect_timeout_ms(0),
+          connect_response() {}
 
     virtual int connect(IPAddress ip, uint16_t port) override;
     virtual int connect(const char * host, uint16_t port) override;
@@ -123,12 +381,92 @@ public:
     String path;
     String protocol;
 
+    // Duration of the phases of the last connect() call, in microseconds
+    // since connect() was called.  Phases which were not reached are 0.
+    struct Timing {
+        unsigned long tcp_connected;
+        unsigned long request_sent;
+        unsigned long response_received;
+        unsigned long handshake_complete;
+    };
+
+    const Timing & get_timing() const { return timing; }
+
+    // Non-blocking connect.  start_connect() only prepares the connection and
+    // returns immediately, poll_connect() must then be called periodically to
+    // move it forward.  Each call performs at most one step of the process
+    // and returns the current state; the connection is usable once it reaches
+    // open.  If it's not open within timeout_ms, it's closed and the state
+    // changes to failed.
+    // NOTE: Most Arduino clients can only establish the TCP connection in a
+    // blocking way, so the first poll_connect() call can block for the time
+    // it takes (unless the socket is already connected).  The rest of the
+    // handshake never blocks.
+    enum class ConnectState : uint8_t {
+        idle,
+        connecting,
+        tcp_connected,
+        request_sent,
+        response_parsed,
+        open,
+        failed,
+    };
+
+    void start_connect(const char * host, uint16_t port,
+                       unsigned long timeout_ms = 10000);
+    void start_connect(IPAddress ip, uint16_t port,
+                       unsigned long timeout_ms = 10000);
+    ConnectState poll_connect();
+    ConnectState get_connect_state() const { return connect_state; }
+
 protected:
+    // called whenever the state of a non-blocking connect changes
+    virtual void on_connect_state(ConnectState state) {}
+
     virtual void on_http_line_too_long() override;
     virtual void on_http_timeout() override;
     virtual void on_http_violation() override;
     void on_http_error();
+
+    void start_timing();
+    unsigned long elapsed_us() const {
+        return clock_micros() - connect_start_us;
+    }
+
+    // flags collected while parsing the handshake response headers
+    struct HandshakeResponse {
+        bool connection_upgrade;
+        bool upgrade_websocket;
+        bool sec_websocket_protocol;
+        bool sec_websocket_accept;
+    };
+
     bool handshake(const String & host);
+    String send_handshake_request(const String & host);
+    bool read_handshake_response(const String & sec_websocket_key);
+    bool check_response_status(const String & line);
+    void check_response_header(const std::pair<String, String> & header,
+                               const String & sec_websocket_key,
+                               HandshakeResponse & response);
+    bool check_response(const HandshakeResponse & response);
+
+    void set_connect_state(ConnectState state);
+    void fail_connect();
+
+    Timing timing;
+    unsigned long connect_start_us;
+
+    // non-blocking connect state
+    ConnectState connect_state;
+    String connect_host;
+    IPAddress connect_ip;
+    bool connect_use_ip;
+    uint16_t connect_port;
+    unsigned long connect_start_ms;
+    unsigned long connect_timeout_ms;
+    String connect_key;
+    String connect_line;
+    HandshakeResponse connect_response;
 };
 
 template <typename Socket>
@@ -146,7 +484,26 @@ class ServerInterface {
 public:
     ServerInterface(const String & protocol = "",
                     unsigned long socket_timeout_ms = 1000)
-        : protocol(protocol), socket_timeout_ms(socket_timeout_ms) {}
+        : protocol(protocol),
+          socket_timeout_ms(socket_timeout_ms),
+          memory_budget(nullptr),
+          timers(nullptr),
+          idle_timeout_ms(0),
+          max_incoming_frame_size(0),
+          max_incoming_message_size(0),
+          wait_strategy(nullptr),
+          coalesce_pongs(false),
+          max_control_frame_rate(0),
+          max_connections(0),
+          max_pending_handshakes(0),
+          accept_rate(0),
+          accept_burst(0),
+          reject_silently(false),
+          connections(0),
+          pending_handshakes(0),
+          rejected(0),
+          accept_tokens(ULONG_MAX),
+          accept_refill_ms(0) {}
     virtual ~ServerInterface() {}
 
     virtual bool check_url(const String & url) { return true; }
@@ -155,17 +512,151 @@ public:
         return true;
     }
 
+    // Find the endpoint which handles url, returns nullptr if there's none.
+    // Routing servers return a different ServerInterface for each route, its
+    // protocol, check_http_header() and callbacks are used for the connection.
+    virtual ServerInterface * resolve(const String & url) {
+        return check_url(url) ? this : nullptr;
+    }
+
     virtual void on_pong(ServerClient & client, const void * data,
                          const size_t size) {}
 
+    // Called by ServerClient::dispatch() when data is available.
+    virtual void on_message(ServerClient & client) {}
+
     String protocol;
     unsigned long socket_timeout_ms;
+
+    // Shared by all connections, nullptr means no accounting.  Handshakes are
+    // refused with 503 when the budget is exhausted.
+    MemoryBudget * memory_budget;
+
+    // Optional timer wheel used to enforce connection timeouts, it must be
+    // advanced from the loop which serves the connections.  Handshakes and
+    // close handshakes which take longer than socket_timeout_ms are aborted.
+    // Connections which receive nothing for idle_timeout_ms are closed with
+    // code 1001 (0 disables the idle timeout).
+    TimerWheel * timers;
+    unsigned long idle_timeout_ms;
+
+    // Limits applied to all connections, see ClientBase.
+    size_t max_incoming_frame_size;
+    size_t max_incoming_message_size;
+
+    // Wait strategy used by all connections, see ClientBase.
+    WaitStrategy * wait_strategy;
+
+    // Control frame handling of all connections, see ClientBase.
+    bool coalesce_pongs;
+    unsigned int max_control_frame_rate;
+
+    // Admission control, checked as soon as a connection is accepted, before
+    // any of the request is read.  Connections over a limit get a fixed 503
+    // response (or are just dropped if reject_silently is set), without any
+    // parsing, allocation or hashing.  0 disables a limit.  Connections are
+    // counted from the start of the handshake until their ServerClient is
+    // destroyed or the handshake fails.
+    size_t max_connections;
+    size_t max_pending_handshakes;
+
+    // Token bucket limiting the rate of new connections: accept_rate
+    // connections per second on average, with bursts of up to accept_burst
+    // (at least 1).
+    unsigned long accept_rate;
+    unsigned long accept_burst;
+
+    bool reject_silently;
+
+    size_t get_connections() const { return connections; }
+    size_t get_pending_handshakes() const { return pending_handshakes; }
+    unsigned long get_rejected() const { return rejected; }
+
+    // Close all connections in clients, a container of ServerClient objects
+    // (e.g. std::list<Server<WiFiServer>::Client>).  Close frames are sent to
+    // all connections first, then the replies are collected from all of them
+    // in parallel under a single socket_timeout_ms deadline.  Connections
+    // which don't reply in time are dropped.  Returns the number of
+    // connections closed gracefully.
+    template <typename Container>
+    size_t shutdown(Container & clients, uint16_t code = 1001);
+
+protected:
+    // Check the admission limits for a new connection and take a token from
+    // the bucket.  Returns false if the connection must be rejected.
+    bool admit_connection();
+
+    // atomic, connections may be destroyed on other threads (see
+    // PicoWebsocketSharded.h)
+    std::atomic<size_t> connections;
+    std::atomic<size_t> pending_handshakes;
+    unsigned long rejected;
+
+    // tokens in thousandths, ULONG_MAX means the bucket is full
+    unsigned long accept_tokens;
+    unsigned long accept_refill_ms;
+
+    friend class ServerClient;
+};
+
+// Per connection bookkeeping of FairScheduler (see PicoWebsocketScheduler.h).
+struct ScheduleStats {
+    ScheduleStats()
+        : deficit(0),
+          bytes_served(0),
+          deferred_rounds(0),
+          waiting_since(0),
+          max_wait_ms(0) {}
+
+    // bytes the connection may still consume in the current round
+    size_t deficit;
+
+    // total payload bytes passed to the handler
+    unsigned long bytes_served;
+
+    // number of rounds which ended with unserved data left
+    unsigned long deferred_rounds;
+
+    // millis() when unserved data was first left behind, 0 if there's none
+    unsigned long waiting_since;
+
+    // longest time data was left waiting
+    unsigned long max_wait_ms;
 };
 
 class ServerClient : public ClientBase {
 public:
     ServerClient(::Client & client, ServerInterface & server)
-        : ClientBase(client, server.socket_timeout_ms, false), server(server) {}
+        : ClientBase(client, server.socket_timeout_ms, false),
+          server(server),
+          endpoint(&server),
+          timeout(*this),
+          timeout_phase(TimeoutPhase::handshake),
+          timers(server.timers),
+          admission(Admission::none) {
+        memory_budget = server.memory_budget;
+        max_incoming_frame_size = server.max_incoming_frame_size;
+        max_incoming_message_size = server.max_incoming_message_size;
+        wait_strategy = server.wait_strategy;
+        coalesce_pongs = server.coalesce_pongs;
+        max_control_frame_rate = server.max_control_frame_rate;
+    }
+
+    virtual ~ServerClient();
+
+    // The endpoint which accepted the connection.
+    ServerInterface & get_endpoint() { return *endpoint; }
+
+    // Pass the connection to the endpoint's on_message() if data is
+    // available.  Returns true if it was called.
+    bool dispatch();
+
+    ScheduleStats schedule;
+
+    // Move the connection's timeout to another wheel (nullptr disables it),
+    // e.g. when the connection is handed over to another thread.  Initially
+    // the server's wheel is used.
+    void set_timers(TimerWheel * wheel);
 
     virtual int connect(IPAddress ip, uint16_t port) override { return 0; }
     virtual int connect(const char * host, uint16_t port) override { return 0; }
@@ -186,14 +677,97 @@ protected:
     virtual void on_http_violation() override;
     void on_http_error(const unsigned short code, const String & message);
     void handshake();
+    void handshake_request();
+
+    // Register the connection with the server's admission control.  If it's
+    // over the limits, the connection is rejected and false is returned.
+    // Called by handshake() unless it was called before.
+    bool admit();
+    void end_pending_handshake();
+
+    // Copies of a connection share the admission of the original.
+    void copy_admission(const ServerClient & other);
 
     void on_pong(const void * data, const size_t size) {
-        server.on_pong(*this, data, size);
+        endpoint->on_pong(*this, data, size);
     }
 
+    class Timeout : public Timer {
+    public:
+        Timeout(ServerClient & owner) : owner(owner) {}
+
+    protected:
+        virtual void on_timeout() override { owner.on_timeout(); }
+        ServerClient & owner;
+    };
+
+    enum class TimeoutPhase { handshake, idle, close_wait };
+
+    void on_timeout();
+    void start_idle_timeout();
+
     ServerInterface & server;
+    ServerInterface * endpoint;
+
+    Timeout timeout;
+    TimeoutPhase timeout_phase;
+    TimerWheel * timers;
+
+    enum class Admission : uint8_t { none, pending, open };
+    Admission admission;
 };
 
+template <typename Container>
+size_t ServerInterface::shutdown(Container & clients, uint16_t code) {
+    size_t open = 0;
+    for (auto & client : clients) {
+        ServerClient & connection = client;
+        if (connection.connected()) {
+            connection.begin_close(code);
+            ++open;
+        }
+    }
+
+    const unsigned long start_time = clock_millis();
+    size_t pending = open;
+    unsigned int attempt = 0;
+    while (pending) {
+        const size_t previous = pending;
+        ServerClient * waiting = nullptr;
+        pending = 0;
+        for (auto & client : clients) {
+            ServerClient & connection = client;
+            if (!connection.poll_close()) {
+                ++pending;
+                waiting = waiting ? waiting : &connection;
+            }
+        }
+
+        const unsigned long elapsed_ms = clock_millis() - start_time;
+        if (!pending || (elapsed_ms > socket_timeout_ms)) {
+            break;
+        }
+
+        // Wait for one of the remaining replies, all of them are needed
+        // anyway.  The others are picked up in the next round.
+        if (pending < previous) {
+            attempt = 0;
+        }
+        waiting->wait_for_socket(WaitStrategy::Event::readable,
+                                 socket_timeout_ms - elapsed_ms, attempt++);
+    }
+
+    // out of time, drop the rest
+    for (auto & client : clients) {
+        ServerClient & connection = client;
+        if (connection.connected()) {
+            connection.abort();
+        }
+    }
+
+    return open - pending;
+}
+
 template <typename ServerSocket>
 class Server : public ServerInterface {
 protected:
@@ -215,7 +789,13 @@ public:
 
         Client(const Client & other)
             : SocketOwner<ClientSocket>(other.socket),
-              PicoWebsocket::ServerClient(this->socket, other.server) {}
+              PicoWebsocket::ServerClient(this->socket, other.server) {
+            this->endpoint = other.endpoint;
+            this->timers = other.timers;
+            this->timeout.copy_deadline(other.timeout);
+            this->timeout_phase = other.timeout_phase;
+            this->copy_admission(other);
+        }
     };
 
     Server(ServerSocket & server, const String & protocol = "",
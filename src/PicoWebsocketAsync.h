@@ -0,0 +1,963 @@
+#pragma once
+
+// Coroutine based front end for host builds.
+//
+// The classes below run the regular PicoWebsocket protocol code, but instead
+// of busy-polling the socket they suspend the calling coroutine and let a
+// Reactor resume it once the socket is ready.  This way a single thread can
+// serve many connections at once.
+//
+// The synchronous framing and handshake code is reused as is.  It runs
+// against an in-memory BufferedClient, which only exposes data that has been
+// fully received (complete frames or complete HTTP headers).  This guarantees
+// that the synchronous code never has to wait for the network.
+//
+// NOTE: Results of co_await expressions are always stored in a variable
+// before being tested.  Some GCC versions (e.g. 12.x) miscompile coroutines
+// which use co_await directly in a condition or in a logical expression.
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "PicoWebsocketAsync.h requires a compiler with C++20 coroutine support"
+#endif
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "PicoWebsocket.h"
+#include "PicoWebsocketMemory.h"
+
+namespace PicoWebsocket {
+namespace Async {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<Promise> handle) noexcept {
+            PromiseBase & promise = handle.promise();
+            if (promise.detached) {
+                // nobody is waiting for the result, clean up
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation ? promise.continuation
+                                        : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct Promise : public PromiseBase {
+    Task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T value;
+};
+
+template <>
+struct Promise<void> : public PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+}  // namespace detail
+
+// Lazily started coroutine.  A Task starts running when it's awaited or when
+// it's detached.
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle(handle) {}
+    Task(Task && other) noexcept
+        : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task & operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    T await_resume() {
+        if constexpr (!std::is_void<T>::value) {
+            return std::move(handle.promise().value);
+        }
+    }
+
+    // Start the task without waiting for its result.  The coroutine frame is
+    // freed automatically when the task finishes.
+    void detach() {
+        auto h = std::exchange(handle, nullptr);
+        h.promise().detached = true;
+        h.resume();
+    }
+
+protected:
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(
+        std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+// The Reactor decides when suspended operations are resumed.  Implementations
+// are free to resume a coroutine early (e.g. on a spurious wakeup), callers
+// always recheck the socket state after resuming.
+class Reactor {
+public:
+    enum class Event { readable, writable };
+
+    virtual ~Reactor() {}
+
+    // Resume handle once event is signalled on client or when timeout_ms
+    // elapses.  A timeout of 0 means no timeout.
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      std::coroutine_handle<> handle) = 0;
+
+    // Resume handle once event is signalled on the file descriptor fd or
+    // when timeout_ms elapses.  Only reactors able to watch file descriptors
+    // override this, by default handle is resumed on the next iteration.
+    virtual void wait(int fd, Event event, unsigned long timeout_ms,
+                      std::coroutine_handle<> handle) {
+        defer(handle);
+    }
+
+    // Resume handle on the next iteration of the reactor loop.
+    virtual void defer(std::coroutine_handle<> handle) = 0;
+
+    struct Awaiter {
+        Reactor & reactor;
+        ::Client * client;
+        int fd;
+        Event event;
+        unsigned long timeout_ms;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            if (client) {
+                reactor.wait(*client, event, timeout_ms, handle);
+            } else if (fd >= 0) {
+                reactor.wait(fd, event, timeout_ms, handle);
+            } else {
+                reactor.defer(handle);
+            }
+        }
+        void await_resume() const noexcept {}
+    };
+
+    Awaiter until(::Client & client, Event event,
+                  unsigned long timeout_ms = 0) {
+        return Awaiter{*this, &client, -1, event, timeout_ms};
+    }
+
+    Awaiter until(int fd, Event event, unsigned long timeout_ms = 0) {
+        return Awaiter{*this, nullptr, fd, event, timeout_ms};
+    }
+
+    Awaiter next() { return Awaiter{*this, nullptr, -1, Event::readable, 0}; }
+};
+
+// Reactor which works with any ::Client.  It has no way of sleeping until a
+// socket becomes ready, so it checks all waiting sockets on every call to
+// poll().  Still, the checks for all connections are done in a single loop on
+// a single thread.
+class PollingReactor : public Reactor {
+public:
+    using Reactor::wait;
+
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      std::coroutine_handle<> handle) override {
+        waiters.push_back({&client, event, clock_millis(), timeout_ms, handle});
+    }
+
+    virtual void defer(std::coroutine_handle<> handle) override {
+        waiters.push_back({nullptr, Event::readable, 0, 0, handle});
+    }
+
+    // Resume all coroutines which are ready to continue.  Returns false if
+    // there's nothing left to wait for.
+    bool poll() {
+        std::vector<Waiter> current;
+        current.swap(waiters);
+        for (auto & waiter : current) {
+            if (waiter.ready()) {
+                waiter.handle.resume();
+            } else {
+                waiters.push_back(waiter);
+            }
+        }
+        return !waiters.empty();
+    }
+
+    void run() {
+        while (poll()) {
+            yield();
+        }
+    }
+
+protected:
+    struct Waiter {
+        ::Client * client;
+        Event event;
+        unsigned long start_time;
+        unsigned long timeout_ms;
+        std::coroutine_handle<> handle;
+
+        bool ready() const {
+            if (!client || (event == Event::writable)) {
+                return true;
+            }
+            if (timeout_ms && (clock_millis() - start_time >= timeout_ms)) {
+                return true;
+            }
+            return client->available() || !client->connected();
+        }
+    };
+
+    std::vector<Waiter> waiters;
+};
+
+// In-memory ::Client placed between the synchronous protocol code and the
+// transport.  Only data explicitly released by the coroutine front end is
+// visible to reads, writes are collected in a buffer and sent out later.
+class BufferedClient : public ::Client {
+public:
+    BufferedClient(::Client & transport)
+        : transport(transport), read_pos(0), read_limit(0), stopping(false) {}
+
+    virtual int connect(IPAddress ip, uint16_t port) override {
+        return transport.connect(ip, port);
+    }
+    virtual int connect(const char * host, uint16_t port) override {
+        return transport.connect(host, port);
+    }
+
+    virtual size_t write(const uint8_t * buffer, size_t size) override {
+        out.insert(out.end(), buffer, buffer + size);
+        return size;
+    }
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+
+    virtual int available() override { return read_limit - read_pos; }
+
+    virtual int read(uint8_t * buffer, size_t size) override {
+        const size_t available = read_limit - read_pos;
+        const size_t read_size = available < size ? available : size;
+        memcpy(buffer, in.data() + read_pos, read_size);
+        read_pos += read_size;
+        return read_size;
+    }
+
+    virtual int read() override {
+        uint8_t c;
+        return read(&c, 1) ? c : -1;
+    }
+
+    virtual int peek() override {
+        return (read_pos < read_limit) ? in[read_pos] : -1;
+    }
+
+    virtual void flush() override {}
+
+    // The transport is only stopped once all pending output (e.g. a close
+    // frame) has been sent out.
+    virtual void stop() override { stopping = true; }
+
+    virtual uint8_t connected() override {
+        return !stopping && (transport.connected() || available());
+    }
+
+    virtual operator bool() override { return bool(transport); }
+
+    // Move up to max_size bytes waiting on the transport to the input
+    // buffer.
+    void receive(size_t max_size = SIZE_MAX) {
+        if (read_pos) {
+            in.erase(in.begin(), in.begin() + read_pos);
+            read_limit -= read_pos;
+            read_pos = 0;
+        }
+        const int available = transport.available();
+        if (available <= 0) {
+            return;
+        }
+        const size_t read_size =
+            (size_t)available < max_size ? available : max_size;
+        const size_t size = in.size();
+        in.resize(size + read_size);
+        const int bytes_read = transport.read(in.data() + size, read_size);
+        in.resize(size + (bytes_read > 0 ? bytes_read : 0));
+    }
+
+    // bytes held in the input buffer
+    size_t buffered_size() const { return in.size() - read_pos; }
+
+    // data received, but not visible to reads yet
+    const uint8_t * pending() const { return in.data() + read_limit; }
+    size_t pending_size() const { return in.size() - read_limit; }
+    void release(size_t size) { read_limit += size; }
+
+    ::Client & transport;
+
+    std::vector<uint8_t> in;
+    size_t read_pos;
+    size_t read_limit;
+
+    std::vector<uint8_t> out;
+    bool stopping;
+};
+
+// Received message.  While a message is being reassembled, its data is
+// charged to the connection's memory budget, once complete it belongs to the
+// application.
+struct Message {
+    bool binary;
+    std::vector<uint8_t> data;
+};
+
+// Exposes the internals of a ClientBase subclass to the coroutine front end.
+template <typename Base>
+class Protocol : public Base {
+public:
+    using Base::Base;
+    using Base::client;
+    using Base::close;
+    using Base::in_message;
+    using Base::on_http_timeout;
+
+    // Process a single, completely buffered frame.  Data is appended to
+    // message, complete is set once the final frame of a message has been
+    // read.  Returns false if the connection failed.
+    bool read_frame(Message & message, bool & complete) {
+        const auto opcode = this->read_head();
+
+        switch (opcode) {
+            case Base::Opcode::DATA_CONTINUATION:
+            case Base::Opcode::DATA_TEXT:
+            case Base::Opcode::DATA_BINARY: {
+                const bool continuation =
+                    (opcode == Base::Opcode::DATA_CONTINUATION);
+                if (continuation != this->in_message) {
+                    this->on_violation();
+                    return false;
+                }
+
+                if (!continuation) {
+                    message.binary = (opcode == Base::Opcode::DATA_BINARY);
+                    message.data.clear();
+                }
+
+                const size_t offset = message.data.size();
+                message.data.resize(offset + this->in_frame_size);
+                if (this->in_frame_size &&
+                    !this->read_payload(message.data.data() + offset,
+                                        this->in_frame_size, true)) {
+                    return false;
+                }
+
+                this->in_message = !this->in_frame_fin;
+                complete = this->in_frame_fin;
+                return true;
+            }
+
+            case Base::Opcode::ERR:
+                return false;
+
+            default:
+                this->handle_control_frame(opcode);
+                return this->client.connected();
+        }
+    }
+};
+
+class ClientProtocol : public Protocol<PicoWebsocket::Client> {
+public:
+    using Protocol<PicoWebsocket::Client>::Protocol;
+    using PicoWebsocket::Client::elapsed_us;
+    using PicoWebsocket::Client::read_handshake_response;
+    using PicoWebsocket::Client::send_handshake_request;
+    using PicoWebsocket::Client::start_timing;
+    using PicoWebsocket::Client::timing;
+};
+
+class ServerProtocol : public Protocol<PicoWebsocket::ServerClient> {
+public:
+    using Protocol<PicoWebsocket::ServerClient>::Protocol;
+    using PicoWebsocket::ServerClient::admit;
+    using PicoWebsocket::ServerClient::handshake;
+};
+
+// Size of the complete frame at the beginning of data or 0 if more data is
+// needed to complete it.  Data frames with a payload larger than max_payload
+// (unless it's 0) are released as soon as their header is complete, so that
+// read_head() can reject them without buffering the payload first.
+inline size_t frame_size(const uint8_t * data, const size_t size,
+                         const size_t max_payload = 0) {
+    if (size < 2) {
+        return 0;
+    }
+
+    uint64_t payload_length = data[1] & 0x7f;
+    const size_t extended_payload_length_bytes =
+        (payload_length == 126) ? 2 : ((payload_length == 127) ? 8 : 0);
+    const size_t head_size =
+        2 + extended_payload_length_bytes + ((data[1] & 0x80) ? 4 : 0);
+
+    if (size < head_size) {
+        return 0;
+    }
+
+    if (extended_payload_length_bytes) {
+        payload_length = 0;
+        for (size_t i = 0; i < extended_payload_length_bytes; ++i) {
+            payload_length = (payload_length << 8) | data[2 + i];
+        }
+    }
+
+    if (max_payload && !(data[0] & 0x08) && (payload_length > max_payload)) {
+        return head_size;
+    }
+
+    if (payload_length > size - head_size) {
+        return 0;
+    }
+
+    return head_size + payload_length;
+}
+
+// Measure used by Connection::receive() to buffer whole frames.
+struct FrameSize {
+    size_t max_payload;
+    size_t operator()(const uint8_t * data, const size_t size) const {
+        return frame_size(data, size, max_payload);
+    }
+};
+
+// Size of the complete HTTP header block at the beginning of data, 0 if more
+// data is needed.  If a line turns out to be too long, all data is returned so
+// that the HTTP code can reject it.
+inline size_t http_head_size(const uint8_t * data, const size_t size) {
+    size_t line_start = 0;
+    for (size_t i = 0; i + 1 < size; ++i) {
+        if (data[i] != '\r' || data[i + 1] != '\n') {
+            continue;
+        }
+        if (i == line_start) {
+            // empty line, end of headers
+            return i + 2;
+        }
+        line_start = i + 2;
+    }
+    return (size - line_start > PICOWEBSOCKET_MAX_HTTP_LINE_LENGTH) ? size : 0;
+}
+
+template <typename Websocket>
+class Connection {
+public:
+    template <typename... Args>
+    Connection(Reactor & reactor, ::Client & transport, Args &&... args)
+        : reactor(reactor),
+          io(transport),
+          websocket(io, std::forward<Args>(args)...),
+          charged(0),
+          charged_output(0),
+          reassembly_size(0) {}
+
+    ~Connection() {
+        charge(0);
+        io.out.clear();
+        charge_output();
+    }
+
+    Connection(const Connection &) = delete;
+    Connection & operator=(const Connection &) = delete;
+
+    // Receive a complete message.  Control frames received in the meantime
+    // are handled transparently.  Returns false if the connection is lost.
+    Task<bool> read_message(Message & message) {
+        while (true) {
+            const bool received = co_await receive(frame_measure(), 0);
+            if (!received) {
+                co_return false;
+            }
+
+            bool complete = false;
+            const bool ok = websocket.read_frame(message, complete);
+            reassembly_size = complete ? 0 : message.data.size();
+            charge(io.buffered_size() + reassembly_size);
+
+            // send out replies to control frames
+            const bool sent = co_await send();
+            if (!sent || !ok) {
+                co_return false;
+            }
+
+            if (complete) {
+                co_return true;
+            }
+        }
+    }
+
+    Task<bool> write(const void * buffer, size_t size, bool fin = true,
+                     bool bin = true) {
+        const size_t written = websocket.write(buffer, size, fin, bin);
+        const bool sent = co_await send();
+        co_return sent && (written == size);
+    }
+
+    Task<bool> ping(const void * payload = nullptr, size_t size = 0) {
+        websocket.ping(payload, size);
+        co_return co_await send();
+    }
+
+    // Close the connection gracefully, waiting for the peer to reply with a
+    // close frame.
+    Task<void> stop(uint16_t code = 1000) {
+        websocket.close(code);
+
+        // wait for the close reply, discard any data received in the meantime
+        Message message;
+        bool complete;
+        while (true) {
+            const bool sent = co_await send();
+            if (!sent) {
+                break;
+            }
+            const bool received =
+                co_await receive(frame_measure(), websocket.socket_timeout_ms);
+            if (!received) {
+                break;
+            }
+            if (!websocket.read_frame(message, complete)) {
+                break;
+            }
+            message.data.clear();
+        }
+        reassembly_size = 0;
+        charge(io.buffered_size());
+
+        io.transport.stop();
+    }
+
+    bool connected() { return websocket.connected(); }
+
+    Websocket & protocol() { return websocket; }
+
+protected:
+    // Wait for data on the transport and move it to the input buffer.
+    // Returns false if the connection is lost or if no data arrives within
+    // timeout_ms.
+    Task<bool> fill(unsigned long timeout_ms) {
+        const unsigned long start_time = clock_millis();
+        while (true) {
+            const int available = io.transport.available();
+            if (available > 0) {
+                const size_t size = reserve_input(available);
+                if (size) {
+                    io.receive(size);
+                    co_return true;
+                }
+                // Out of memory, leave the data in the socket, so that TCP
+                // flow control slows the peer down, and retry on the next
+                // iteration.  Time spent here doesn't count as a timeout.
+                co_await reactor.next();
+                continue;
+            }
+            if (!io.transport.connected()) {
+                co_return false;
+            }
+            const unsigned long elapsed_ms = clock_millis() - start_time;
+            if (timeout_ms && (elapsed_ms >= timeout_ms)) {
+                co_return false;
+            }
+            co_await reactor.until(io.transport, Reactor::Event::readable,
+                                   timeout_ms ? timeout_ms - elapsed_ms : 0);
+        }
+    }
+
+    // Set the amount of memory charged to the memory budget to size.
+    // Returns false if the budget can't cover it.
+    bool charge(size_t size) {
+        MemoryBudget * budget = websocket.memory_budget;
+        if (!budget) {
+            return true;
+        }
+        if (size > charged) {
+            if (!budget->acquire(size - charged)) {
+                return false;
+            }
+        } else {
+            budget->release(charged - size);
+        }
+        charged = size;
+        return true;
+    }
+
+    // Charge the output which hasn't been sent yet to the memory budget.  It's
+    // already allocated, so it's charged even if that exceeds the budget.
+    void charge_output() {
+        MemoryBudget * budget = websocket.memory_budget;
+        if (!budget) {
+            return;
+        }
+        const size_t size = io.out.size();
+        if (size > charged_output) {
+            budget->claim(size - charged_output);
+        } else {
+            budget->release(charged_output - size);
+        }
+        charged_output = size;
+    }
+
+    // Number of bytes missing from a control frame at the beginning of the
+    // input, 0 if the input doesn't start with a control frame.
+    size_t control_frame_remainder() {
+        const uint8_t * data = io.pending();
+        const size_t size = io.pending_size();
+        if (!size) {
+            const int c = io.transport.peek();
+            return ((c >= 0) && (c & 0x08)) ? 2 : 0;
+        }
+        if (!(data[0] & 0x08)) {
+            return 0;
+        }
+        if (size < 2) {
+            return 2 - size;
+        }
+        // control frame payloads never need an extended length
+        const size_t frame =
+            2 + ((data[1] & 0x80) ? 4 : 0) + (data[1] & 0x7f);
+        return frame > size ? frame - size : 0;
+    }
+
+    // Number of bytes (up to size) which may be moved to the input buffer.
+    // While the budget is under pressure, no new messages are received, but
+    // control frames are, so that pings are answered and closing handshakes
+    // complete.
+    // NOTE: If the budget is exhausted by incomplete messages, the
+    // connections holding them stall, use max_incoming_message_size to
+    // prevent this.
+    size_t reserve_input(size_t size) {
+        MemoryBudget * budget = websocket.memory_budget;
+        if (!budget) {
+            return size;
+        }
+
+        const size_t held = io.buffered_size() + reassembly_size;
+        if (!websocket.in_message && budget->under_pressure()) {
+            const size_t control = control_frame_remainder();
+            if (control) {
+                // read nothing beyond the control frame
+                if (size > control) {
+                    size = control;
+                }
+            } else if (!held) {
+                return 0;
+            }
+        }
+
+        const size_t limit = charged + budget->available();
+        if (held >= limit) {
+            return 0;
+        }
+        if (size > limit - held) {
+            size = limit - held;
+        }
+        return charge(held + size) ? size : 0;
+    }
+
+    // Frames larger than the incoming size limits don't need to be buffered,
+    // they'll be rejected anyway.
+    FrameSize frame_measure() const {
+        const size_t frame_limit = websocket.max_incoming_frame_size;
+        const size_t message_limit = websocket.max_incoming_message_size;
+        if (!frame_limit || (message_limit && (message_limit < frame_limit))) {
+            return FrameSize{message_limit};
+        }
+        return FrameSize{frame_limit};
+    }
+
+    // Wait until a complete unit of data (as determined by measure) is
+    // buffered and release it to the protocol code.  The connection is
+    // dropped if no data arrives within idle_timeout_ms (0 means no timeout).
+    template <typename Measure>
+    Task<bool> receive(Measure measure, unsigned long idle_timeout_ms) {
+        size_t size;
+        while (!(size = measure(io.pending(), io.pending_size()))) {
+            // Once data has started arriving, the rest must follow within the
+            // socket timeout, just like in ClientBase::read_all().
+            const unsigned long timeout_ms = io.pending_size()
+                                                 ? websocket.socket_timeout_ms
+                                                 : idle_timeout_ms;
+            const bool filled = co_await fill(timeout_ms);
+            if (!filled) {
+                if (io.transport.connected()) {
+                    // timeout
+                    io.transport.stop();
+                }
+                co_return false;
+            }
+        }
+        io.release(size);
+        co_return true;
+    }
+
+    // Receive a complete HTTP header block.
+    Task<bool> receive_http_head() {
+        while (!http_head_size(io.pending(), io.pending_size())) {
+            const bool filled = co_await fill(websocket.socket_timeout_ms);
+            if (!filled) {
+                if (io.transport.connected()) {
+                    websocket.on_http_timeout();
+                    co_await send();
+                }
+                co_return false;
+            }
+        }
+        io.release(http_head_size(io.pending(), io.pending_size()));
+        co_return true;
+    }
+
+    // Send out all buffered output.
+    Task<bool> send() {
+        charge_output();
+        while (!io.out.empty()) {
+            const size_t written =
+                io.transport.write(io.out.data(), io.out.size());
+            if (written) {
+                io.out.erase(io.out.begin(), io.out.begin() + written);
+                charge_output();
+                continue;
+            }
+            if (!io.transport.connected()) {
+                break;
+            }
+            co_await reactor.until(io.transport, Reactor::Event::writable);
+        }
+
+        if (io.stopping) {
+            io.transport.stop();
+            co_return false;
+        }
+
+        co_return io.out.empty();
+    }
+
+    Reactor & reactor;
+    BufferedClient io;
+    Websocket websocket;
+
+    // memory charged to websocket.memory_budget for input and output
+    size_t charged;
+    size_t charged_output;
+    size_t reassembly_size;
+};
+
+class Client : public Connection<ClientProtocol> {
+public:
+    Client(Reactor & reactor, ::Client & client, const String & path = "/",
+           const String & protocol = "", unsigned long socket_timeout_ms = 1000)
+        : Connection<ClientProtocol>(reactor, client, path, protocol,
+                                            socket_timeout_ms) {}
+
+    // NOTE: The TCP connection is established by the transport's connect()
+    // method, only the websocket handshake is asynchronous.
+    Task<bool> connect(IPAddress ip, uint16_t port) {
+        websocket.start_timing();
+        if (!io.transport.connect(ip, port)) {
+            co_return false;
+        }
+        co_return co_await handshake(ip.toString());
+    }
+
+    Task<bool> connect(const char * host, uint16_t port) {
+        websocket.start_timing();
+        if (!io.transport.connect(host, port)) {
+            co_return false;
+        }
+        co_return co_await handshake(host);
+    }
+
+protected:
+    Task<bool> handshake(const String host) {
+        io.in.clear();
+        io.read_pos = io.read_limit = 0;
+        io.out.clear();
+        io.stopping = false;
+        websocket.in_message = false;
+        websocket.timing.tcp_connected = websocket.elapsed_us();
+
+        const String sec_websocket_key = websocket.send_handshake_request(host);
+        const bool sent = co_await send();
+        if (!sent) {
+            co_return false;
+        }
+        websocket.timing.request_sent = websocket.elapsed_us();
+
+        const bool received = co_await receive_http_head();
+        if (!received) {
+            co_return false;
+        }
+
+        const bool ok = websocket.read_handshake_response(sec_websocket_key);
+        charge(io.buffered_size());
+        co_await send();
+        co_return ok;
+    }
+};
+
+template <typename ServerSocket>
+class Server : public ServerInterface {
+protected:
+    ServerSocket & server;
+
+public:
+    using ClientSocket = decltype(server.accept());
+
+    class Client : public SocketOwner<ClientSocket>,
+                   public Connection<ServerProtocol> {
+    public:
+        Client(Reactor & reactor, const ClientSocket & client,
+               ServerInterface & server)
+            : SocketOwner<ClientSocket>(client),
+              Connection<ServerProtocol>(reactor, this->socket,
+                                                      server) {}
+
+        Task<bool> handshake() {
+            if (!websocket.admit()) {
+                // over the limits, send the rejection (if any) right away
+                co_await send();
+                co_return false;
+            }
+            const bool received = co_await receive_http_head();
+            if (!received) {
+                co_return false;
+            }
+            websocket.handshake();
+            charge(io.buffered_size());
+            const bool ok = websocket.connected();
+            const bool sent = co_await send();
+            co_return sent && ok;
+        }
+    };
+
+    Server(Reactor & reactor, ServerSocket & server,
+           const String & protocol = "", unsigned long socket_timeout_ms = 1000)
+        : ServerInterface(protocol, socket_timeout_ms),
+          server(server),
+          reactor(reactor),
+          watching(false) {}
+
+    void begin() { server.begin(); }
+
+    // Wait for the next client which completed the websocket handshake.
+    // Handshakes of multiple clients are processed concurrently.
+    Task<std::unique_ptr<Client>> accept() {
+        while (ready.empty()) {
+            ClientSocket socket = server.accept();
+            if (socket) {
+                handshake(std::make_unique<Client>(reactor, socket, *this))
+                    .detach();
+            } else if constexpr (requires { server.fd(); }) {
+                // the server socket exposes a file descriptor, which the
+                // reactor may be able to watch, sleep until a connection
+                // arrives or until a pending handshake completes
+                co_await AcceptWait{*this};
+            } else {
+                co_await reactor.next();
+            }
+        }
+        std::unique_ptr<Client> client = std::move(ready.front());
+        ready.pop_front();
+        co_return std::move(client);
+    }
+
+protected:
+    Task<void> handshake(std::unique_ptr<Client> client) {
+        const bool ok = co_await client->handshake();
+        if (ok) {
+            ready.push_back(std::move(client));
+            wake_accept();
+        }
+    }
+
+    // Suspends accept() until wake_accept() is called.  A single watcher
+    // coroutine waits on the server socket on behalf of accept(), so that
+    // completed handshakes can wake it up too.
+    struct AcceptWait {
+        Server & server;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            server.accept_waiter = handle;
+            if (!server.watching) {
+                server.watching = true;
+                server.watch_server_socket().detach();
+            }
+        }
+        void await_resume() const noexcept {}
+    };
+
+    Task<void> watch_server_socket() {
+        co_await reactor.until(server.fd(), Reactor::Event::readable);
+        watching = false;
+        wake_accept();
+    }
+
+    void wake_accept() {
+        if (accept_waiter) {
+            reactor.defer(std::exchange(accept_waiter, nullptr));
+        }
+    }
+
+    Reactor & reactor;
+    std::deque<std::unique_ptr<Client>> ready;
+    std::coroutine_handle<> accept_waiter;
+    bool watching;
+};
+
+}  // namespace Async
+}  // namespace PicoWebsocket
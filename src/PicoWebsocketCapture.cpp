@@ -0,0 +1,313 @@
+#include "PicoWebsocketCapture.h"
+
+namespace {
+
+const uint8_t magic[] = {'P', 'W', 'S', 'C', 1};
+
+enum RecordKind : uint8_t {
+    FRAME_HEAD = 0x00,
+    FRAME_PAYLOAD = 0x01,
+    OUTGOING = 0x80,
+};
+
+}  // namespace
+
+namespace PicoWebsocket {
+
+void FrameRecorder::write_varint(unsigned long value) {
+    uint8_t buffer[10];
+    size_t size = 0;
+    do {
+        buffer[size] = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            buffer[size] |= 0x80;
+        }
+        ++size;
+    } while (value);
+    output.write(buffer, size);
+}
+
+void FrameRecorder::on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                                  size_t payload_length) {
+    const unsigned long now = clock_millis();
+    if (!started) {
+        output.write(magic, sizeof(magic));
+        last_record_ms = now;
+        started = true;
+    }
+
+    const uint8_t head[] = {
+        (uint8_t)(FRAME_HEAD | (outgoing ? OUTGOING : 0)),
+        (uint8_t)((opcode & 0x0f) | (fin ? 0x80 : 0)),
+    };
+    output.write(head, sizeof(head));
+    write_varint(now - last_record_ms);
+    write_varint(payload_length);
+    last_record_ms = now;
+}
+
+void FrameRecorder::on_frame_payload(bool outgoing, const void * data,
+                                     size_t size) {
+    if (!started) {
+        // payload without a head, we've probably been attached in the middle
+        // of a frame
+        return;
+    }
+    const uint8_t kind = FRAME_PAYLOAD | (outgoing ? OUTGOING : 0);
+    output.write(&kind, 1);
+    write_varint(size);
+    output.write((const uint8_t *)data, size);
+}
+
+ReplayClient::ReplayClient(Stream & capture, bool mask, bool realtime)
+    : frames_replayed(0),
+      bytes_replayed(0),
+      bytes_written(0),
+      capture(capture),
+      mask(mask),
+      realtime(realtime),
+      head_size(0),
+      head_pos(0),
+      payload_pos(0),
+      frame_remaining(0),
+      record_remaining(0),
+      padding(false),
+      head_pending(false),
+      pending_opcode(0),
+      pending_length(0),
+      start_ms(0),
+      due_ms(0),
+      header_checked(false),
+      eof(false),
+      stopped(false) {}
+
+bool ReplayClient::read_varint(unsigned long & value) {
+    value = 0;
+    for (unsigned int shift = 0; shift < 8 * sizeof(value); shift += 7) {
+        const int c = capture.read();
+        if (c < 0) {
+            return false;
+        }
+        value |= (unsigned long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ReplayClient::skip(size_t size) {
+    while (size-- && (capture.read() >= 0)) {
+    }
+}
+
+bool ReplayClient::load() {
+    if (!header_checked) {
+        header_checked = true;
+        uint8_t buffer[sizeof(magic)];
+        if ((capture.readBytes(buffer, sizeof(buffer)) != sizeof(buffer)) ||
+            memcmp(buffer, magic, sizeof(magic))) {
+            eof = true;
+        }
+        start_ms = clock_millis();
+    }
+
+    while (true) {
+        if (head_pos < head_size) {
+            return true;
+        }
+
+        if (frame_remaining) {
+            if (record_remaining || padding) {
+                return true;
+            }
+        } else if (record_remaining) {
+            // the payload record was longer than the frame, drop the excess
+            skip(record_remaining);
+            record_remaining = 0;
+        }
+
+        if (!frame_remaining && head_pending) {
+            if (realtime && (clock_millis() - start_ms < due_ms)) {
+                // next frame not due yet
+                return false;
+            }
+
+            // render the frame header
+            uint8_t * pos = head;
+            *pos++ = pending_opcode;
+            const uint8_t mask_bit = mask ? 0x80 : 0;
+            if (pending_length <= 125) {
+                *pos++ = pending_length | mask_bit;
+            } else if (pending_length <= 0xffff) {
+                *pos++ = 126 | mask_bit;
+                *pos++ = (pending_length >> 8) & 0xff;
+                *pos++ = pending_length & 0xff;
+            } else {
+                *pos++ = 127 | mask_bit;
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    *pos++ = (uint64_t)pending_length >> shift;
+                }
+            }
+            if (mask) {
+                const uint32_t key = (uint32_t)random();
+                memcpy(mask_key, &key, 4);
+                memcpy(pos, mask_key, 4);
+                pos += 4;
+            }
+
+            head_size = pos - head;
+            head_pos = 0;
+            payload_pos = 0;
+            frame_remaining = pending_length;
+            padding = false;
+            head_pending = false;
+            ++frames_replayed;
+            continue;
+        }
+
+        if (eof) {
+            if (frame_remaining) {
+                // payload is missing from the capture
+                padding = true;
+                continue;
+            }
+            return false;
+        }
+
+        // read the next record
+        const int kind = capture.read();
+        if (kind < 0) {
+            eof = true;
+            continue;
+        }
+
+        const bool outgoing = kind & OUTGOING;
+        switch (kind & ~OUTGOING) {
+            case FRAME_HEAD: {
+                const int opcode = capture.read();
+                unsigned long delta_ms;
+                unsigned long length;
+                if ((opcode < 0) || !read_varint(delta_ms) ||
+                    !read_varint(length)) {
+                    eof = true;
+                    break;
+                }
+                due_ms += delta_ms;
+                if (!outgoing) {
+                    head_pending = true;
+                    pending_opcode = opcode;
+                    pending_length = length;
+                    // if the previous frame's payload is incomplete, pad it
+                    padding = frame_remaining;
+                }
+                break;
+            }
+
+            case FRAME_PAYLOAD: {
+                unsigned long size;
+                if (!read_varint(size)) {
+                    eof = true;
+                    break;
+                }
+                if (outgoing || !frame_remaining || head_pending) {
+                    skip(size);
+                } else {
+                    record_remaining = size;
+                }
+                break;
+            }
+
+            default: {
+                // corrupted capture
+                eof = true;
+                break;
+            }
+        }
+    }
+}
+
+bool ReplayClient::finished() {
+    load();
+    return eof && !head_pending && !frame_remaining && (head_pos >= head_size);
+}
+
+int ReplayClient::available() {
+    if (stopped || !load()) {
+        return 0;
+    }
+
+    if (head_pos < head_size) {
+        return head_size - head_pos;
+    }
+
+    const size_t segment = padding ? frame_remaining : record_remaining;
+    return segment < frame_remaining ? segment : frame_remaining;
+}
+
+int ReplayClient::read(uint8_t * buffer, size_t size) {
+    size_t total = 0;
+    while ((total < size) && !stopped && load()) {
+        size_t chunk = size - total;
+
+        if (head_pos < head_size) {
+            if (chunk > head_size - head_pos) {
+                chunk = head_size - head_pos;
+            }
+            memcpy(buffer + total, head + head_pos, chunk);
+            head_pos += chunk;
+            total += chunk;
+            continue;
+        }
+
+        if (chunk > frame_remaining) {
+            chunk = frame_remaining;
+        }
+
+        if (padding) {
+            memset(buffer + total, 0, chunk);
+        } else {
+            if (chunk > record_remaining) {
+                chunk = record_remaining;
+            }
+            chunk = capture.readBytes(buffer + total, chunk);
+            if (!chunk) {
+                eof = true;
+                record_remaining = 0;
+                continue;
+            }
+            record_remaining -= chunk;
+        }
+
+        if (mask) {
+            for (size_t i = 0; i < chunk; ++i) {
+                buffer[total + i] ^= mask_key[(payload_pos + i) & 3];
+            }
+        }
+
+        payload_pos += chunk;
+        frame_remaining -= chunk;
+        bytes_replayed += chunk;
+        total += chunk;
+    }
+    return total;
+}
+
+int ReplayClient::peek() {
+    if (stopped || !load()) {
+        return -1;
+    }
+
+    if (head_pos < head_size) {
+        return head[head_pos];
+    }
+
+    const int c = padding ? 0 : capture.peek();
+    if (c < 0) {
+        return -1;
+    }
+    return mask ? c ^ mask_key[payload_pos & 3] : c;
+}
+
+}  // namespace PicoWebsocket
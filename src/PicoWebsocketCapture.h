@@ -0,0 +1,122 @@
+#pragma once
+
+// Frame level traffic capture and replay.
+//
+// A FrameRecorder set as a connection's tap writes all frames sent and
+// received to a Print (e.g. a File) in a compact binary format.  A
+// ReplayClient reads such a capture and plays back the received frames as an
+// Arduino ::Client, so a websocket created on top of it sees exactly the
+// traffic the original connection saw.
+//
+// Capture format: the magic bytes "PWSC" and a version byte (1), followed by
+// records.  Numbers are encoded as unsigned LEB128 varints.
+//
+//   frame head:  kind byte 0x00 (| 0x80 if outgoing), opcode byte (| 0x80 if
+//                fin), ms since the previous record, payload length
+//   payload:     kind byte 0x01 (| 0x80 if outgoing), size, unmasked data
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "PicoWebsocket.h"
+
+namespace PicoWebsocket {
+
+class FrameRecorder : public FrameTap {
+public:
+    FrameRecorder(Print & output)
+        : output(output), last_record_ms(0), started(false) {}
+
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override;
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override;
+
+protected:
+    void write_varint(unsigned long value);
+
+    Print & output;
+    unsigned long last_record_ms;
+    bool started;
+};
+
+// ::Client which plays back the incoming frames of a capture.  Outgoing
+// frames of the capture are skipped and anything written to the client is
+// discarded.  Frames are masked if mask is true (use it when replaying to a
+// server side connection).  If realtime is true, frames become available at
+// the same pace as they were captured, otherwise as fast as possible.
+class ReplayClient : public ::Client {
+public:
+    ReplayClient(Stream & capture, bool mask, bool realtime = false);
+
+    virtual int connect(IPAddress ip, uint16_t port) override { return 1; }
+    virtual int connect(const char * host, uint16_t port) override {
+        return 1;
+    }
+
+    virtual size_t write(const uint8_t * buffer, size_t size) override {
+        bytes_written += size;
+        return size;
+    }
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+
+    virtual int available() override;
+    virtual int read(uint8_t * buffer, size_t size) override;
+    virtual int read() override {
+        uint8_t c;
+        return (read(&c, 1) == 1) ? c : -1;
+    }
+    virtual int peek() override;
+
+    virtual void flush() override {}
+    virtual void stop() override { stopped = true; }
+
+    // Connected until the capture is played back completely.
+    virtual uint8_t connected() override { return !stopped && !finished(); }
+    virtual operator bool() override { return !stopped; }
+
+    bool finished();
+
+    // statistics
+    unsigned long frames_replayed;
+    unsigned long bytes_replayed;
+    unsigned long bytes_written;
+
+protected:
+    bool read_varint(unsigned long & value);
+    bool load();
+    void skip(size_t size);
+
+    Stream & capture;
+    const bool mask;
+    const bool realtime;
+
+    // rendered frame header
+    uint8_t head[14];
+    size_t head_size;
+    size_t head_pos;
+
+    uint8_t mask_key[4];
+    size_t payload_pos;
+
+    // payload bytes of the current frame still to be replayed, the part of
+    // the current payload record still unread and the padding needed if the
+    // capture doesn't contain the whole payload
+    size_t frame_remaining;
+    size_t record_remaining;
+    bool padding;
+
+    // head record read from the capture, but not due yet
+    bool head_pending;
+    uint8_t pending_opcode;
+    unsigned long pending_length;
+
+    unsigned long start_ms;
+    unsigned long due_ms;
+
+    bool header_checked;
+    bool eof;
+    bool stopped;
+};
+
+}  // namespace PicoWebsocket
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace PicoWebsocket {
+
+// Time source of the library.  All timeouts and timestamps are based on
+// clock_millis(), which calls millis() unless another clock was installed
+// with set_clock().  Tests can run connections on virtual time this way (see
+// PicoWebsocketEmulator.h).
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual unsigned long millis() = 0;
+    virtual unsigned long micros() = 0;
+};
+
+// Install clock, nullptr restores the system clock.  Returns the previous
+// clock.
+// NOTE: The clock is global, don't switch it while connections are open.
+Clock * set_clock(Clock * clock);
+
+extern Clock * active_clock;
+
+inline unsigned long clock_millis() {
+    return active_clock ? active_clock->millis() : ::millis();
+}
+
+inline unsigned long clock_micros() {
+    return active_clock ? active_clock->micros() : ::micros();
+}
+
+}  // namespace PicoWebsocket
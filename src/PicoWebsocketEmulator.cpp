@@ -0,0 +1,300 @@
+#include "PicoWebsocketEmulator.h"
+
+#include <limits>
+
+namespace PicoWebsocket {
+namespace Emulator {
+
+Network::Pipe::Pipe(Network & network, const LinkConfig & config,
+                    uint32_t seed)
+    : network(network),
+      config(config),
+      random_state(seed ? seed : 1),
+      in_flight_size(0),
+      link_free_us(0),
+      last_due_us(0),
+      fin_sent(false),
+      fin_delivered(false),
+      fin_due_us(0) {}
+
+uint32_t Network::Pipe::random() {
+    // xorshift32, deterministic and independent of the Arduino random()
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+size_t Network::Pipe::send(const uint8_t * data, size_t size) {
+    if (fin_sent) {
+        return 0;
+    }
+
+    if (config.max_write_chunk && (size > config.max_write_chunk)) {
+        size = config.max_write_chunk;
+    }
+    if (config.send_buffer) {
+        const size_t space = config.send_buffer > in_flight_size
+                                 ? config.send_buffer - in_flight_size
+                                 : 0;
+        if (size > space) {
+            size = space;
+        }
+    }
+
+    const uint64_t now = network.clock.now_us;
+    const size_t mss = config.mss ? config.mss : size;
+    for (size_t offset = 0; offset < size; offset += mss) {
+        const size_t segment_size = (size - offset < mss) ? size - offset : mss;
+
+        // serialization delay, segments queue up behind each other
+        uint64_t departure = link_free_us > now ? link_free_us : now;
+        if (config.bandwidth) {
+            departure += (uint64_t)segment_size * 1000000ull / config.bandwidth;
+        }
+        link_free_us = departure;
+
+        uint64_t due = departure + config.latency_us;
+        if (config.jitter_us) {
+            due += random() % (config.jitter_us + 1);
+        }
+        for (unsigned int attempt = 0; (attempt < 8) && (config.loss > 0) &&
+                                       (random() < config.loss * 4294967295.0);
+             ++attempt) {
+            due += config.retransmit_us;
+            ++network.retransmissions;
+        }
+
+        // TCP delivers in order
+        if (due < last_due_us) {
+            due = last_due_us;
+        }
+        last_due_us = due;
+
+        in_flight.push_back(
+            Segment{due, std::vector<uint8_t>(data + offset,
+                                              data + offset + segment_size)});
+        ++network.segments;
+    }
+
+    in_flight_size += size;
+    network.bytes_sent += size;
+    return size;
+}
+
+void Network::Pipe::close() {
+    if (fin_sent) {
+        return;
+    }
+    fin_sent = true;
+    const uint64_t due = network.clock.now_us + config.latency_us;
+    fin_due_us = due > last_due_us ? due : last_due_us;
+}
+
+void Network::Pipe::update() {
+    const uint64_t now = network.clock.now_us;
+    while (!in_flight.empty() && (in_flight.front().due_us <= now)) {
+        const Segment & segment = in_flight.front();
+        delivered.insert(delivered.end(), segment.data.begin(),
+                         segment.data.end());
+        in_flight_size -= segment.data.size();
+        network.bytes_delivered += segment.data.size();
+        in_flight.pop_front();
+    }
+    if (fin_sent && in_flight.empty() && (fin_due_us <= now)) {
+        fin_delivered = true;
+    }
+}
+
+uint64_t Network::Pipe::next_event() const {
+    if (!in_flight.empty()) {
+        return in_flight.front().due_us;
+    }
+    if (fin_sent && !fin_delivered) {
+        return fin_due_us;
+    }
+    return std::numeric_limits<uint64_t>::max();
+}
+
+Network::Network(uint32_t seed)
+    : bytes_sent(0),
+      bytes_delivered(0),
+      segments(0),
+      retransmissions(0),
+      previous_clock(set_clock(&clock)),
+      seed(seed),
+      connection_count(0) {}
+
+Network::~Network() { set_clock(previous_clock); }
+
+uint64_t Network::next_event() {
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    for (auto it = connections.begin(); it != connections.end();) {
+        std::shared_ptr<Connection> connection = it->lock();
+        if (!connection) {
+            it = connections.erase(it);
+            continue;
+        }
+        for (Pipe * pipe : {&connection->upstream, &connection->downstream}) {
+            // deliver what's due, so that only future events remain
+            pipe->update();
+            const uint64_t event = pipe->next_event();
+            if (event < next) {
+                next = event;
+            }
+        }
+        ++it;
+    }
+    return next;
+}
+
+void Network::advance(unsigned long us) {
+    clock.now_us += us;
+    next_event();
+}
+
+bool Network::step() {
+    const uint64_t next = next_event();
+    if (next == std::numeric_limits<uint64_t>::max()) {
+        return false;
+    }
+    if (next > clock.now_us) {
+        clock.now_us = next;
+    }
+    next_event();
+    return true;
+}
+
+void Network::wait(::Client & client, Event event, unsigned long timeout_ms,
+                   unsigned int attempt) {
+    // time passes on every wait, even if the timeout is just running out
+    const uint64_t deadline =
+        clock.now_us + (timeout_ms ? timeout_ms : 1) * 1000ull;
+    const uint64_t next = next_event();
+    clock.now_us = next < deadline ? next : deadline;
+    next_event();
+}
+
+Network::Pipe * Client::incoming() {
+    return side ? &connection->upstream : &connection->downstream;
+}
+
+Network::Pipe * Client::outgoing() {
+    return side ? &connection->downstream : &connection->upstream;
+}
+
+int Client::connect(IPAddress ip, uint16_t port) {
+    return connect(nullptr, port);
+}
+
+int Client::connect(const char * host, uint16_t port) {
+    if (!network) {
+        return 0;
+    }
+
+    stop();
+
+    auto server = network->servers.find(port);
+    if (server == network->servers.end()) {
+        return 0;
+    }
+
+    connection = std::make_shared<Network::Connection>(
+        *network, network->seed + 2 * network->connection_count++);
+    side = 0;
+    network->connections.push_back(connection);
+    server->second->backlog.push_back(Client(*network, connection, 1));
+
+    // SYN and SYN-ACK
+    network->advance(network->upstream.latency_us +
+                     network->downstream.latency_us);
+    return 1;
+}
+
+size_t Client::write(const uint8_t * buffer, size_t size) {
+    if (!connection || stopped()) {
+        return 0;
+    }
+    if (connection->stopped[!side]) {
+        // the peer is gone, the data goes nowhere
+        return size;
+    }
+    return outgoing()->send(buffer, size);
+}
+
+int Client::available() {
+    if (!connection || stopped()) {
+        return 0;
+    }
+    Network::Pipe * pipe = incoming();
+    pipe->update();
+    size_t size = pipe->delivered.size();
+    if (pipe->config.max_read_chunk && (size > pipe->config.max_read_chunk)) {
+        size = pipe->config.max_read_chunk;
+    }
+    return size;
+}
+
+int Client::read(uint8_t * buffer, size_t size) {
+    const size_t available_size = available();
+    if (size > available_size) {
+        size = available_size;
+    }
+    if (!size) {
+        // also covers stopped clients, which have no connection anymore
+        return 0;
+    }
+    std::deque<uint8_t> & delivered = incoming()->delivered;
+    std::copy(delivered.begin(), delivered.begin() + size, buffer);
+    delivered.erase(delivered.begin(), delivered.begin() + size);
+    return size;
+}
+
+int Client::peek() {
+    if (!available()) {
+        return -1;
+    }
+    return incoming()->delivered.front();
+}
+
+void Client::stop() {
+    if (!connection) {
+        return;
+    }
+    if (!stopped()) {
+        connection->stopped[side] = true;
+        outgoing()->close();
+        incoming()->delivered.clear();
+    }
+    connection.reset();
+}
+
+uint8_t Client::connected() {
+    if (!connection || stopped()) {
+        return 0;
+    }
+    Network::Pipe * pipe = incoming();
+    pipe->update();
+    return !pipe->fin_delivered || !pipe->delivered.empty();
+}
+
+void Server::begin() { network.servers[port] = this; }
+
+void Server::end() {
+    auto it = network.servers.find(port);
+    if ((it != network.servers.end()) && (it->second == this)) {
+        network.servers.erase(it);
+    }
+}
+
+Client Server::accept() {
+    if (backlog.empty()) {
+        return Client();
+    }
+    Client client = backlog.front();
+    backlog.pop_front();
+    return client;
+}
+
+}  // namespace Emulator
+}  // namespace PicoWebsocket
@@ -0,0 +1,268 @@
+#pragma once
+
+// In-memory network emulator running on virtual time, for tests and
+// benchmarks on the host.
+//
+// Emulator::Client is an Arduino ::Client and Emulator::Server a server
+// socket for PicoWebsocket::Server, connected through an Emulator::Network.
+// Each direction of a connection is modelled as a TCP stream with limited
+// bandwidth, latency, jitter and loss (which shows up as retransmission
+// delay, like on a real TCP connection).  Writes and reads can be cut into
+// arbitrary chunks to exercise partial I/O.
+//
+// The network installs a virtual clock (see PicoWebsocketClock.h) and is a
+// WaitStrategy, which advances the clock to the next delivery instead of
+// waiting, so blocking calls complete instantly in real time:
+//
+//   PicoWebsocket::Emulator::Network network;
+//   network.upstream.latency_us = 50000;
+//   network.upstream.bandwidth = 100000;     // bytes per second
+//   network.downstream = network.upstream;
+//
+//   PicoWebsocket::Emulator::Server server_socket(network, 80);
+//   PicoWebsocket::Server<PicoWebsocket::Emulator::Server> server(
+//       server_socket);
+//   server.wait_strategy = &network;
+//
+//   PicoWebsocket::Emulator::Client client_socket(network);
+//   PicoWebsocket::Client websocket(client_socket, "/");
+//   websocket.wait_strategy = &network;
+//
+// Everything runs on a single thread.  Since a blocking handshake needs the
+// other side to respond, use the non-blocking connect (start_connect() and
+// poll_connect()) on the client side and step() the network in between.
+// The server's handshake blocks until the request arrives, so accept the
+// connection once the client is in the request_sent state.
+// Results only depend on the configuration and the seed.
+// NOTE: Only one Network should exist at a time, it owns the global clock.
+// It must outlive the clients and servers using it.
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "PicoWebsocketClock.h"
+#include "PicoWebsocketWait.h"
+
+namespace PicoWebsocket {
+namespace Emulator {
+
+class VirtualClock : public Clock {
+public:
+    VirtualClock() : now_us(0) {}
+
+    virtual unsigned long millis() override { return now_us / 1000; }
+    virtual unsigned long micros() override { return now_us; }
+
+    uint64_t now_us;
+};
+
+// Properties of one direction of a connection.
+struct LinkConfig {
+    LinkConfig()
+        : bandwidth(0),
+          latency_us(0),
+          jitter_us(0),
+          loss(0),
+          retransmit_us(200000),
+          mss(1460),
+          send_buffer(0),
+          max_write_chunk(0),
+          max_read_chunk(0) {}
+
+    // bytes per second, 0 means unlimited
+    unsigned long bandwidth;
+
+    // one way delay of each segment, plus a random extra delay of up to
+    // jitter_us (segments are still delivered in order)
+    unsigned long latency_us;
+    unsigned long jitter_us;
+
+    // probability of losing a segment (0..1), each loss delays the segment
+    // by retransmit_us
+    float loss;
+    unsigned long retransmit_us;
+
+    // writes are cut into segments of up to mss bytes
+    size_t mss;
+
+    // bytes which may be in flight, writes are cut short when it's full, 0
+    // means unlimited
+    size_t send_buffer;
+
+    // maximum number of bytes accepted by a single write() and returned by a
+    // single read() (or reported by available()), 0 means unlimited
+    size_t max_write_chunk;
+    size_t max_read_chunk;
+};
+
+class Client;
+class Server;
+
+class Network : public WaitStrategy {
+public:
+    // The network's clock is installed when it's created and the previous
+    // clock is restored when it's destroyed.
+    Network(uint32_t seed = 1);
+    virtual ~Network();
+
+    Network(const Network &) = delete;
+    Network & operator=(const Network &) = delete;
+
+    // Link properties of connections created from now on.
+    LinkConfig upstream;    // client to server
+    LinkConfig downstream;  // server to client
+
+    // Move the clock forward, delivering the data which arrives meanwhile.
+    void advance(unsigned long us);
+    void advance_ms(unsigned long ms) { advance(ms * 1000ul); }
+
+    // Move the clock to the next delivery.  Returns false if nothing is in
+    // flight.
+    bool step();
+
+    uint64_t now_us() const { return clock.now_us; }
+
+    // Blocking calls of connections using the network as their wait strategy
+    // skip ahead to the next delivery, or to the timeout if there's none.
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override;
+
+    // totals over all connections
+    unsigned long long bytes_sent;
+    unsigned long long bytes_delivered;
+    unsigned long segments;
+    unsigned long retransmissions;
+
+    VirtualClock clock;
+
+protected:
+    // One direction of a connection.
+    struct Pipe {
+        Pipe(Network & network, const LinkConfig & config, uint32_t seed);
+
+        size_t send(const uint8_t * data, size_t size);
+        void close();
+        void update();
+        // time of the next delivery, UINT64_MAX if there's none
+        uint64_t next_event() const;
+        uint32_t random();
+
+        Network & network;
+        const LinkConfig config;
+        uint32_t random_state;
+
+        struct Segment {
+            uint64_t due_us;
+            std::vector<uint8_t> data;
+        };
+        std::deque<Segment> in_flight;
+        size_t in_flight_size;
+        std::deque<uint8_t> delivered;
+
+        uint64_t link_free_us;
+        uint64_t last_due_us;
+
+        // end of stream
+        bool fin_sent;
+        bool fin_delivered;
+        uint64_t fin_due_us;
+    };
+
+    struct Connection {
+        Connection(Network & network, uint32_t seed)
+            : upstream(network, network.upstream, seed),
+              downstream(network, network.downstream, seed * 2 + 1),
+              stopped{false, false} {}
+
+        Pipe upstream;
+        Pipe downstream;
+        bool stopped[2];
+    };
+
+    uint64_t next_event();
+
+    Clock * previous_clock;
+    uint32_t seed;
+    unsigned long connection_count;
+    std::vector<std::weak_ptr<Connection>> connections;
+    std::map<uint16_t, Server *> servers;
+
+    friend class Client;
+    friend class Server;
+};
+
+// One end of an emulated connection.  Copies share the connection, just like
+// copies of a WiFiClient do.
+class Client : public ::Client {
+public:
+    Client() : network(nullptr), side(0) {}
+    Client(Network & network) : network(&network), side(0) {}
+
+    // Connects to the Server listening on port, the host is ignored.  Takes
+    // one round trip of virtual time.
+    virtual int connect(IPAddress ip, uint16_t port) override;
+    virtual int connect(const char * host, uint16_t port) override;
+
+    virtual size_t write(const uint8_t * buffer, size_t size) override;
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+
+    virtual int available() override;
+    virtual int read(uint8_t * buffer, size_t size) override;
+    virtual int read() override {
+        uint8_t c;
+        return (read(&c, 1) == 1) ? c : -1;
+    }
+    virtual int peek() override;
+
+    virtual void flush() override {}
+    virtual void stop() override;
+
+    virtual uint8_t connected() override;
+
+    virtual operator bool() override { return bool(connection); }
+
+protected:
+    Client(Network & network, std::shared_ptr<Network::Connection> connection,
+           uint8_t side)
+        : network(&network), connection(connection), side(side) {}
+
+    Network::Pipe * incoming();
+    Network::Pipe * outgoing();
+    bool stopped() const { return connection->stopped[side]; }
+
+    Network * network;
+    std::shared_ptr<Network::Connection> connection;
+    uint8_t side;  // 0 is the client, 1 the server end
+
+    friend class Server;
+};
+
+class Server {
+public:
+    Server(Network & network, uint16_t port) : network(network), port(port) {}
+    ~Server() { end(); }
+
+    Server(const Server &) = delete;
+    Server & operator=(const Server &) = delete;
+
+    void begin();
+    void end();
+
+    // Returns an invalid Client if no connection is waiting.
+    Client accept();
+
+protected:
+    Network & network;
+    const uint16_t port;
+    std::deque<Client> backlog;
+
+    friend class Client;
+};
+
+}  // namespace Emulator
+}  // namespace PicoWebsocket
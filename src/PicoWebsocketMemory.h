@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+namespace PicoWebsocket {
+
+// Memory governor shared by connections (and message queues).  Buffers are
+// only allocated if they fit in the budget.  When the budget is exhausted,
+// connections stop pulling data from the socket (so TCP flow control slows
+// down the peers) and new handshakes are refused with 503.  Can be used from
+// multiple tasks.
+class MemoryBudget {
+public:
+    // limit is the total number of bytes which may be held in buffers.  Each
+    // handshake in progress reserves handshake_reserve bytes.
+    MemoryBudget(size_t limit, size_t handshake_reserve = 1024)
+        : limit(limit),
+          handshake_reserve(handshake_reserve),
+          min_free_heap(0),
+          used_bytes(0),
+          high_water_bytes(0),
+          refused(0) {}
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget & operator=(const MemoryBudget &) = delete;
+
+    // Reserve size bytes, returns false if that would exceed the budget.
+    bool acquire(size_t size) {
+#if defined(ESP8266) || defined(ESP32)
+        if (min_free_heap && (ESP.getFreeHeap() < min_free_heap + size)) {
+            ++refused;
+            return false;
+        }
+#endif
+        size_t current = used_bytes.load(std::memory_order_relaxed);
+        do {
+            if (current + size > limit) {
+                ++refused;
+                return false;
+            }
+        } while (!used_bytes.compare_exchange_weak(current, current + size,
+                                                   std::memory_order_relaxed));
+
+        update_high_water_mark(current + size);
+        return true;
+    }
+
+    // Account for size bytes which are already allocated, even if that
+    // exceeds the budget.  Other users are held back until they're released.
+    void claim(size_t size) {
+        update_high_water_mark(
+            used_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+    }
+
+    void release(size_t size) {
+        used_bytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    size_t used() const { return used_bytes.load(std::memory_order_relaxed); }
+    size_t available() const {
+        const size_t current = used();
+        return current < limit ? limit - current : 0;
+    }
+
+    // True when more than 3/4 of the budget is in use.  Idle buffers are
+    // released in this state.
+    bool under_pressure() const { return used() > limit - limit / 4; }
+
+    // the highest usage seen so far
+    size_t high_water_mark() const {
+        return high_water_bytes.load(std::memory_order_relaxed);
+    }
+    void reset_high_water_mark() {
+        high_water_bytes.store(used(), std::memory_order_relaxed);
+    }
+
+    // number of failed acquire() calls
+    unsigned long refusals() const {
+        return refused.load(std::memory_order_relaxed);
+    }
+
+    const size_t limit;
+    size_t handshake_reserve;
+
+    // On ESP boards, also refuse allocations which would leave less than
+    // min_free_heap bytes of heap free.  0 disables the check.
+    size_t min_free_heap;
+
+protected:
+    void update_high_water_mark(size_t now_used) {
+        size_t high_water = high_water_bytes.load(std::memory_order_relaxed);
+        while ((now_used > high_water) &&
+               !high_water_bytes.compare_exchange_weak(
+                   high_water, now_used, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::atomic<size_t> used_bytes;
+    std::atomic<size_t> high_water_bytes;
+    std::atomic<unsigned long> refused;
+};
+
+}  // namespace PicoWebsocket
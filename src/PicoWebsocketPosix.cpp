@@ -0,0 +1,330 @@
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <climits>
+
+#include "PicoWebsocketPosix.h"
+
+#ifdef PICOWEBSOCKET_DEBUG
+#define PICOWEBSOCKET_DEBUG_PRINTF(...) Serial.printf("DBG " __VA_ARGS__)
+#else
+#define PICOWEBSOCKET_DEBUG_PRINTF(...)
+#endif
+
+namespace {
+
+bool set_nonblocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return (flags >= 0) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+}
+
+}  // namespace
+
+namespace PicoWebsocket {
+namespace Posix {
+
+Client::Socket::~Socket() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+Client::Client() : nodelay(true), connect_timeout_ms(5000) {}
+
+Client::Client(int fd, bool nodelay)
+    : nodelay(nodelay),
+      connect_timeout_ms(5000),
+      socket(std::make_shared<Socket>(fd)) {
+    set_nonblocking(fd);
+    set_nodelay(nodelay);
+}
+
+bool Client::set_nodelay(bool enable) {
+    nodelay = enable;
+    if (fd() < 0) {
+        // will be applied on connect
+        return true;
+    }
+    const int value = enable ? 1 : 0;
+    return setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) ==
+           0;
+}
+
+int Client::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int Client::connect(const char * host, uint16_t port) {
+    stop();
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo * addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        PICOWEBSOCKET_DEBUG_PRINTF("Failed to resolve %s\n", host);
+        return 0;
+    }
+
+    for (struct addrinfo * address = addresses; address;
+         address = address->ai_next) {
+        const int fd = ::socket(address->ai_family,
+                                address->ai_socktype | SOCK_CLOEXEC,
+                                address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        auto candidate = std::make_shared<Socket>(fd);
+        set_nonblocking(fd);
+
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            if (errno != EINPROGRESS) {
+                continue;
+            }
+
+            // wait for the connection to complete
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            if (poll(&pfd, 1, connect_timeout_ms) != 1) {
+                PICOWEBSOCKET_DEBUG_PRINTF("Connect timeout\n");
+                continue;
+            }
+
+            int error = 0;
+            socklen_t error_size = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_size) ||
+                error) {
+                continue;
+            }
+        }
+
+        socket = candidate;
+        set_nodelay(nodelay);
+        break;
+    }
+
+    freeaddrinfo(addresses);
+    return socket ? 1 : 0;
+}
+
+size_t Client::write(const uint8_t * buffer, size_t size) {
+    if (!socket) {
+        return 0;
+    }
+
+    const ssize_t ret = ::send(socket->fd, buffer, size, MSG_NOSIGNAL);
+    if (ret >= 0) {
+        return ret;
+    }
+
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+        // Connection broken.  Drop the socket, like WiFiClient does, otherwise
+        // callers would keep retrying for as long as there's unread data.
+        stop();
+    }
+
+    return 0;
+}
+
+int Client::available() {
+    if (!socket) {
+        return 0;
+    }
+    int bytes = 0;
+    if (ioctl(socket->fd, FIONREAD, &bytes) < 0) {
+        return 0;
+    }
+    return bytes;
+}
+
+int Client::read(uint8_t * buffer, size_t size) {
+    if (!socket) {
+        return 0;
+    }
+
+    const ssize_t ret = ::recv(socket->fd, buffer, size, 0);
+    if (ret > 0) {
+        return ret;
+    }
+
+    if ((ret == 0) ||
+        ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+        socket->eof = true;
+    }
+
+    return 0;
+}
+
+int Client::peek() {
+    uint8_t c;
+    if (!socket || (::recv(socket->fd, &c, 1, MSG_PEEK) != 1)) {
+        return -1;
+    }
+    return c;
+}
+
+void Client::stop() { socket.reset(); }
+
+bool Client::check_eof() {
+    if (!socket->eof) {
+        // the peer may have closed the connection in the meantime, that's
+        // only visible when trying to read
+        uint8_t c;
+        const ssize_t ret = ::recv(socket->fd, &c, 1, MSG_PEEK);
+        if ((ret == 0) || ((ret < 0) && (errno != EAGAIN) &&
+                           (errno != EWOULDBLOCK) && (errno != EINTR))) {
+            socket->eof = true;
+        }
+    }
+    return socket->eof;
+}
+
+uint8_t Client::connected() {
+    if (!socket) {
+        return 0;
+    }
+
+    // Like with other Arduino clients, we report being connected as long as
+    // there's unread data.
+    return available() || !check_eof();
+}
+
+Server::Server(uint16_t port, const char * address, int backlog)
+    : nodelay(true),
+      port(port),
+      address(address ? address : ""),
+      backlog(backlog),
+      listen_fd(-1),
+      epoll_fd(-1) {}
+
+Server::~Server() { end(); }
+
+void Server::begin() {
+    end();
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo * addresses;
+    if (getaddrinfo(address.length() ? address.c_str() : nullptr, service,
+                    &hints, &addresses) != 0) {
+        return;
+    }
+
+    for (struct addrinfo * address = addresses; address;
+         address = address->ai_next) {
+        const int fd = ::socket(
+            address->ai_family,
+            address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        const int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        if ((bind(fd, address->ai_addr, address->ai_addrlen) == 0) &&
+            (listen(fd, backlog) == 0)) {
+            listen_fd = fd;
+            break;
+        }
+
+        ::close(fd);
+    }
+
+    freeaddrinfo(addresses);
+
+    if (listen_fd < 0) {
+        PICOWEBSOCKET_DEBUG_PRINTF("Failed to listen on port %u\n", port);
+        return;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+}
+
+void Server::end() {
+    if (epoll_fd >= 0) {
+        ::close(epoll_fd);
+        epoll_fd = -1;
+    }
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+Client Server::accept() {
+    if (listen_fd < 0) {
+        return Client();
+    }
+
+    const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return Client();
+    }
+
+    // Watch the new connection for incoming data.  Closed sockets are removed
+    // from the epoll set automatically.
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+    return Client(fd, nodelay);
+}
+
+int Server::wait(int timeout_ms) {
+    if (epoll_fd < 0) {
+        return 0;
+    }
+
+    struct epoll_event events[64];
+    const int ret = epoll_wait(epoll_fd, events, 64, timeout_ms);
+    return ret > 0 ? ret : 0;
+}
+
+void PollWait::wait(::Client & client, Event event, unsigned long timeout_ms,
+                    unsigned int attempt) {
+    Client * posix_client = dynamic_cast<Client *>(&client);
+    const int fd = posix_client ? posix_client->fd() : -1;
+    if (fd < 0) {
+        yield();
+        return;
+    }
+
+    struct pollfd pfd = {};
+    pfd.fd = fd;
+    pfd.events = (event == Event::readable) ? POLLIN : POLLOUT;
+    ::poll(&pfd, 1, timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms);
+}
+
+}  // namespace Posix
+}  // namespace PicoWebsocket
+
+#endif
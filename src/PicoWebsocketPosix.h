@@ -0,0 +1,314 @@
+#pragma once
+
+// POSIX socket transport for host builds.
+//
+// Posix::Client is an Arduino ::Client backed by a non-blocking TCP socket and
+// Posix::Server is a server socket which can be used with
+// PicoWebsocket::Server.  The server uses epoll, so that a single thread can
+// wait for activity on thousands of connections at once.
+//
+// When coroutine support is available, Posix::Reactor can be used to drive
+// the async API from PicoWebsocketAsync.h.
+
+#ifndef __linux__
+#error "PicoWebsocketPosix.h is only supported on Linux"
+#endif
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <memory>
+
+#include "PicoWebsocketWait.h"
+
+namespace PicoWebsocket {
+namespace Posix {
+
+class Client : public ::Client {
+public:
+    Client();
+
+    // Wrap an already connected socket, the Client takes ownership of fd.
+    explicit Client(int fd, bool nodelay = true);
+
+    virtual int connect(IPAddress ip, uint16_t port) override;
+    virtual int connect(const char * host, uint16_t port) override;
+
+    virtual size_t write(const uint8_t * buffer, size_t size) override;
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+
+    virtual int available() override;
+    virtual int read(uint8_t * buffer, size_t size) override;
+    virtual int read() override {
+        uint8_t c;
+        return (read(&c, 1) == 1) ? c : -1;
+    }
+    virtual int peek() override;
+
+    virtual void flush() override {}
+    virtual void stop() override;
+
+    virtual uint8_t connected() override;
+
+    virtual operator bool() override { return fd() >= 0; }
+
+    // Enable or disable Nagle's algorithm (TCP_NODELAY).  By default Nagle's
+    // algorithm is disabled, because frame headers and payloads are written
+    // separately.
+    bool set_nodelay(bool enable);
+    bool nodelay;
+
+    unsigned long connect_timeout_ms;
+
+    int fd() const { return socket ? socket->fd : -1; }
+
+protected:
+    // Copies of a Client share the same socket, just like copies of a
+    // WiFiClient do.  The socket is closed when the last copy is destroyed or
+    // when stop() is called.
+    struct Socket {
+        Socket(int fd) : fd(fd), eof(false) {}
+        ~Socket();
+        int fd;
+        bool eof;
+    };
+
+    bool check_eof();
+
+    std::shared_ptr<Socket> socket;
+};
+
+class Server {
+public:
+    Server(uint16_t port, const char * address = nullptr, int backlog = 128);
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server & operator=(const Server &) = delete;
+
+    void begin();
+    void end();
+
+    // Accept a pending connection.  Never blocks, returns an invalid Client if
+    // no connection is waiting.
+    Client accept();
+
+    // Wait until a new connection arrives or until data becomes available on
+    // any of the accepted connections.  Returns the number of ready sockets,
+    // 0 on timeout.  A negative timeout means no timeout.
+    int wait(int timeout_ms = -1);
+
+    // listening socket, -1 if the server is not running
+    int fd() const { return listen_fd; }
+
+    // TCP_NODELAY setting for accepted clients
+    bool nodelay;
+
+protected:
+    const uint16_t port;
+    const String address;
+    const int backlog;
+
+    int listen_fd;
+    int epoll_fd;
+};
+
+// WaitStrategy which sleeps in poll() until the socket becomes ready or the
+// timeout expires.  Clients other than Posix::Client have no descriptor to
+// wait on, for them it falls back to yield().
+class PollWait : public WaitStrategy {
+public:
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override;
+};
+
+}  // namespace Posix
+}  // namespace PicoWebsocket
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "PicoWebsocketAsync.h"
+
+namespace PicoWebsocket {
+namespace Posix {
+
+// Async::Reactor which sleeps in epoll_wait() until sockets become ready.
+// Clients other than Posix::Client can't be watched using epoll, operations on
+// them are simply retried on every iteration.
+class Reactor : public Async::Reactor {
+public:
+    Reactor() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), next_id(0) {}
+    virtual ~Reactor() { ::close(epoll_fd); }
+
+    Reactor(const Reactor &) = delete;
+    Reactor & operator=(const Reactor &) = delete;
+
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      std::coroutine_handle<> handle) override {
+        Client * posix_client = dynamic_cast<Client *>(&client);
+        wait(posix_client ? posix_client->fd() : -1, event, timeout_ms,
+             handle);
+    }
+
+    virtual void wait(int fd, Event event, unsigned long timeout_ms,
+                      std::coroutine_handle<> handle) override {
+        if (fd < 0) {
+            defer(handle);
+            return;
+        }
+
+        Entry & entry = entries[fd];
+        Waiter & waiter =
+            (event == Event::readable) ? entry.readable : entry.writable;
+        waiter.handle = handle;
+        waiter.id = ++next_id;
+
+        if (timeout_ms) {
+            deadlines.emplace(millis() + timeout_ms,
+                              Deadline{fd, event, waiter.id});
+        }
+
+        arm(fd, entry);
+    }
+
+    virtual void defer(std::coroutine_handle<> handle) override {
+        deferred.push_back(handle);
+    }
+
+    // Wait for events and resume coroutines which are ready.  Returns false
+    // if there's nothing left to wait for.  A negative timeout_ms means no
+    // timeout.
+    bool run_once(int timeout_ms = -1) {
+        if (!deferred.empty()) {
+            timeout_ms = 0;
+        } else if (!deadlines.empty()) {
+            const unsigned long now = millis();
+            const unsigned long deadline = deadlines.begin()->first;
+            const int remaining = (deadline > now) ? deadline - now : 0;
+            if ((timeout_ms < 0) || (remaining < timeout_ms)) {
+                timeout_ms = remaining;
+            }
+        }
+
+        std::vector<std::coroutine_handle<>> ready;
+
+        struct epoll_event events[64];
+        const int count = epoll_wait(epoll_fd, events, 64, timeout_ms);
+        for (int i = 0; i < count; ++i) {
+            const uint32_t flags = events[i].events;
+            const bool error = flags & (EPOLLERR | EPOLLHUP);
+            take(events[i].data.fd, flags & (EPOLLIN | EPOLLRDHUP) || error,
+                 flags & EPOLLOUT || error, ready);
+        }
+
+        const unsigned long now = millis();
+        while (!deadlines.empty() && (deadlines.begin()->first <= now)) {
+            const Deadline deadline = deadlines.begin()->second;
+            deadlines.erase(deadlines.begin());
+
+            auto it = entries.find(deadline.fd);
+            if (it == entries.end()) {
+                continue;
+            }
+
+            // make sure the waiter hasn't been resumed already
+            const bool readable = (deadline.event == Event::readable);
+            const Waiter & waiter =
+                readable ? it->second.readable : it->second.writable;
+            if (waiter.handle && (waiter.id == deadline.id)) {
+                take(deadline.fd, readable, !readable, ready);
+            }
+        }
+
+        for (auto handle : deferred) {
+            ready.push_back(handle);
+        }
+        deferred.clear();
+
+        for (auto handle : ready) {
+            handle.resume();
+        }
+
+        return !entries.empty() || !deferred.empty();
+    }
+
+    void run() {
+        while (run_once()) {
+        }
+    }
+
+protected:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        unsigned long id = 0;
+    };
+
+    struct Entry {
+        Waiter readable;
+        Waiter writable;
+    };
+
+    struct Deadline {
+        int fd;
+        Event event;
+        unsigned long id;
+    };
+
+    void arm(int fd, const Entry & entry) {
+        struct epoll_event event = {};
+        event.events = EPOLLONESHOT;
+        if (entry.readable.handle) {
+            event.events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (entry.writable.handle) {
+            event.events |= EPOLLOUT;
+        }
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    // Remove the waiters of fd which are ready and add them to ready.
+    void take(int fd, bool readable, bool writable,
+              std::vector<std::coroutine_handle<>> & ready) {
+        auto it = entries.find(fd);
+        if (it == entries.end()) {
+            return;
+        }
+
+        Entry & entry = it->second;
+        if (readable && entry.readable.handle) {
+            ready.push_back(entry.readable.handle);
+            entry.readable = Waiter();
+        }
+        if (writable && entry.writable.handle) {
+            ready.push_back(entry.writable.handle);
+            entry.writable = Waiter();
+        }
+
+        if (entry.readable.handle || entry.writable.handle) {
+            arm(fd, entry);
+        } else {
+            entries.erase(it);
+        }
+    }
+
+    const int epoll_fd;
+    unsigned long next_id;
+    std::unordered_map<int, Entry> entries;
+    std::multimap<unsigned long, Deadline> deadlines;
+    std::vector<std::coroutine_handle<>> deferred;
+};
+
+}  // namespace Posix
+}  // namespace PicoWebsocket
+
+#endif
@@ -0,0 +1,271 @@
+#include "PicoWebsocketPubSub.h"
+
+namespace PicoWebsocket {
+
+PubSub::Node::~Node() {
+    while (children) {
+        Node * child = children;
+        children = child->next;
+        delete child;
+    }
+}
+
+PubSub::~PubSub() {
+    while (subscribers) {
+        unsubscribe(*subscribers->websocket);
+    }
+}
+
+PubSub::Node * PubSub::find(const char * key, bool create) {
+    Node * node = &root;
+    while (*key) {
+        Node * child = node->children;
+        while (child && (child->label[0] != *key)) {
+            child = child->next;
+        }
+
+        if (!child) {
+            if (!create) {
+                return nullptr;
+            }
+            // nothing shares a prefix with the rest of the key
+            child = new Node(key);
+            child->next = node->children;
+            node->children = child;
+            return child;
+        }
+
+        size_t common = 1;
+        while ((common < child->label.length()) &&
+               (key[common] == child->label[common])) {
+            ++common;
+        }
+
+        if (common < child->label.length()) {
+            if (!create) {
+                return nullptr;
+            }
+
+            // the key diverges in the middle of the label, split the node
+            Node * tail = new Node(child->label.substring(common));
+            tail->children = child->children;
+            tail->exact = child->exact;
+            tail->prefix = child->prefix;
+            for (Subscription * s = tail->exact; s; s = s->next) {
+                s->node = tail;
+            }
+            for (Subscription * s = tail->prefix; s; s = s->next) {
+                s->node = tail;
+            }
+
+            child->label = child->label.substring(0, common);
+            child->children = tail;
+            child->exact = nullptr;
+            child->prefix = nullptr;
+        }
+
+        node = child;
+        key += common;
+    }
+
+    return node;
+}
+
+PubSub::Subscriber * PubSub::find(ServerClient & websocket, bool create) {
+    for (Subscriber * subscriber = subscribers; subscriber;
+         subscriber = subscriber->next) {
+        if (subscriber->websocket == &websocket) {
+            return subscriber;
+        }
+    }
+
+    if (!create) {
+        return nullptr;
+    }
+
+    Subscriber * subscriber = new Subscriber{&websocket, nullptr, subscribers,
+                                             publish_count};
+    subscribers = subscriber;
+    return subscriber;
+}
+
+void PubSub::subscribe(const String & topic, ServerClient & websocket) {
+    const bool prefix = topic.endsWith("*");
+    const String key = prefix ? topic.substring(0, topic.length() - 1) : topic;
+
+    Node * node = find(key.c_str(), true);
+    Subscriber * subscriber = find(websocket, true);
+
+    for (Subscription * s = subscriber->subscriptions; s;
+         s = s->next_of_subscriber) {
+        if ((s->node == node) && (s->prefix == prefix)) {
+            // already subscribed
+            return;
+        }
+    }
+
+    Subscription *& head = prefix ? node->prefix : node->exact;
+    Subscription * subscription = new Subscription{
+        subscriber, node, prefix, nullptr, head, subscriber->subscriptions};
+    if (head) {
+        head->prev = subscription;
+    }
+    head = subscription;
+    subscriber->subscriptions = subscription;
+    ++subscription_count;
+}
+
+void PubSub::remove(Subscription * subscription) {
+    if (subscription->prev) {
+        subscription->prev->next = subscription->next;
+    } else if (subscription->prefix) {
+        subscription->node->prefix = subscription->next;
+    } else {
+        subscription->node->exact = subscription->next;
+    }
+    if (subscription->next) {
+        subscription->next->prev = subscription->prev;
+    }
+    delete subscription;
+    --subscription_count;
+}
+
+void PubSub::unsubscribe(const String & topic, ServerClient & websocket) {
+    const bool prefix = topic.endsWith("*");
+    const String key = prefix ? topic.substring(0, topic.length() - 1) : topic;
+
+    Node * node = find(key.c_str(), false);
+    Subscriber * subscriber = find(websocket, false);
+    if (!node || !subscriber) {
+        return;
+    }
+
+    // NOTE: Tree nodes are never removed, topics are expected to come from a
+    // limited set.
+    Subscription ** link = &subscriber->subscriptions;
+    while (*link) {
+        Subscription * s = *link;
+        if ((s->node == node) && (s->prefix == prefix)) {
+            *link = s->next_of_subscriber;
+            remove(s);
+            break;
+        }
+        link = &s->next_of_subscriber;
+    }
+
+    if (!subscriber->subscriptions) {
+        unsubscribe(websocket);
+    }
+}
+
+void PubSub::unsubscribe(ServerClient & websocket) {
+    Subscriber ** link = &subscribers;
+    while (*link && ((*link)->websocket != &websocket)) {
+        link = &(*link)->next;
+    }
+
+    Subscriber * subscriber = *link;
+    if (!subscriber) {
+        return;
+    }
+
+    while (Subscription * s = subscriber->subscriptions) {
+        subscriber->subscriptions = s->next_of_subscriber;
+        remove(s);
+    }
+
+    *link = subscriber->next;
+    delete subscriber;
+}
+
+size_t PubSub::deliver(const char * topic, const uint8_t * frame,
+                       size_t head_size, size_t payload_size) {
+    size_t sent = 0;
+    const Node * node = &root;
+
+    while (node) {
+        // Prefix subscriptions of all nodes on the path match, exact ones
+        // only at the end of the topic.
+        Subscription * lists[] = {node->prefix, *topic ? nullptr : node->exact};
+        for (Subscription * s : lists) {
+            for (; s; s = s->next) {
+                if (!frame) {
+                    // just checking if there are any subscribers
+                    return 1;
+                }
+
+                Subscriber * subscriber = s->subscriber;
+                if (subscriber->last_publish == publish_count) {
+                    // already sent through another subscription
+                    continue;
+                }
+                subscriber->last_publish = publish_count;
+
+                if (subscriber->websocket->write_encoded_frame(
+                        frame, head_size, payload_size) == payload_size) {
+                    ++sent;
+                }
+            }
+        }
+
+        if (!*topic) {
+            break;
+        }
+
+        const Node * child = node->children;
+        while (child && (child->label[0] != *topic)) {
+            child = child->next;
+        }
+
+        if (!child) {
+            break;
+        }
+
+        const char * label = child->label.c_str();
+        while (*label && (*label == *topic)) {
+            ++label;
+            ++topic;
+        }
+
+        // stop if the topic diverges in the middle of the label
+        node = *label ? nullptr : child;
+    }
+
+    return sent;
+}
+
+size_t PubSub::publish(const char * topic, const void * payload, size_t size,
+                       bool bin) {
+    if (!deliver(topic, nullptr, 0, 0)) {
+        // no subscribers, don't bother rendering the frame
+        return 0;
+    }
+
+    const size_t frame_size = 10 + size;
+    if (memory_budget && !memory_budget->acquire(frame_size)) {
+        return 0;
+    }
+
+    uint8_t * frame = (uint8_t *)malloc(frame_size);
+    size_t sent = 0;
+    if (frame) {
+        const size_t head_size = ClientBase::encode_head(
+            frame,
+            bin ? ClientBase::Opcode::DATA_BINARY
+                : ClientBase::Opcode::DATA_TEXT,
+            true, size, false);
+        memcpy(frame + head_size, payload, size);
+
+        ++publish_count;
+        sent = deliver(topic, frame, head_size, size);
+        free(frame);
+    }
+
+    if (memory_budget) {
+        memory_budget->release(frame_size);
+    }
+
+    return sent;
+}
+
+}  // namespace PicoWebsocket
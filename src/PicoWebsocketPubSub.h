@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocket.h"
+#include "PicoWebsocketMemory.h"
+
+namespace PicoWebsocket {
+
+// Topic based publish/subscribe hub for server connections.  Subscriptions
+// are indexed in a prefix tree, so publishing only walks the path of the topic
+// and visits the matching subscribers -- the cost doesn't depend on the total
+// number of connections or topics.  Each published message is rendered into a
+// single frame, which is then sent to all subscribers as is.
+//
+//   hub.subscribe("sensors/kitchen/*", websocket);
+//   hub.publish("sensors/kitchen/temperature", "21.5");
+//
+// The hub keeps pointers to the subscribed connections, so they must not be
+// moved (e.g. keep them in a std::list) and must be unsubscribed before they
+// are destroyed.
+// NOTE: Not thread-safe, use it from the task which owns the connections.
+class PubSub {
+public:
+    // If memory_budget is set, the frame buffers used by publish() are
+    // accounted there.
+    PubSub(MemoryBudget * memory_budget = nullptr)
+        : memory_budget(memory_budget),
+          root(""),
+          subscribers(nullptr),
+          subscription_count(0),
+          publish_count(0) {}
+    ~PubSub();
+
+    PubSub(const PubSub &) = delete;
+    PubSub & operator=(const PubSub &) = delete;
+
+    // Subscribe websocket to topic.  A trailing '*' subscribes to all topics
+    // starting with the given prefix.  Subscribing twice has no effect.
+    void subscribe(const String & topic, ServerClient & websocket);
+    void unsubscribe(const String & topic, ServerClient & websocket);
+
+    // Drop all subscriptions of websocket.
+    void unsubscribe(ServerClient & websocket);
+
+    // Send a message to all connections subscribed to topic.  Connections
+    // with overlapping subscriptions get the message only once.  Returns the
+    // number of connections the message was sent to.
+    size_t publish(const char * topic, const void * payload, size_t size,
+                   bool bin = false);
+    size_t publish(const char * topic, const String & message) {
+        return publish(topic, message.c_str(), message.length());
+    }
+
+    size_t subscriptions() const { return subscription_count; }
+
+    MemoryBudget * memory_budget;
+
+protected:
+    struct Node;
+    struct Subscriber;
+
+    struct Subscription {
+        Subscriber * subscriber;
+        Node * node;
+        bool prefix;
+
+        // subscriptions of the same node
+        Subscription * prev;
+        Subscription * next;
+
+        // subscriptions of the same subscriber
+        Subscription * next_of_subscriber;
+    };
+
+    struct Subscriber {
+        ServerClient * websocket;
+        Subscription * subscriptions;
+        Subscriber * next;
+
+        // publish_count of the last message sent, used to avoid duplicates
+        unsigned long last_publish;
+    };
+
+    struct Node {
+        Node(const String & label)
+            : label(label),
+              children(nullptr),
+              next(nullptr),
+              exact(nullptr),
+              prefix(nullptr) {}
+        ~Node();
+
+        String label;
+        Node * children;
+        Node * next;
+
+        Subscription * exact;
+        Subscription * prefix;
+    };
+
+    Node * find(const char * key, bool create);
+    Subscriber * find(ServerClient & websocket, bool create);
+    void remove(Subscription * subscription);
+
+    // Send frame to all subscribers of topic, returns the number of
+    // connections it was sent to.  If frame is nullptr, only checks if there
+    // are any subscribers.
+    size_t deliver(const char * topic, const uint8_t * frame, size_t head_size,
+                   size_t payload_size);
+
+    Node root;
+    Subscriber * subscribers;
+    size_t subscription_count;
+    unsigned long publish_count;
+};
+
+}  // namespace PicoWebsocket
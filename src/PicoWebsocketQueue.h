@@ -0,0 +1,195 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <limits>
+#include <new>
+
+#include "PicoWebsocket.h"
+#include "PicoWebsocketMemory.h"
+
+namespace PicoWebsocket {
+
+class MpscQueueNode {
+public:
+    MpscQueueNode() : next(nullptr) {}
+
+protected:
+    std::atomic<MpscQueueNode *> next;
+
+    template <typename T>
+    friend class MpscQueue;
+};
+
+// Intrusive, lock-free, multi-producer single-consumer queue (based on
+// Dmitry Vyukov's algorithm).  Any task or thread can push(), but only a
+// single one can pop().  T must derive from MpscQueueNode.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(&stub), tail(&stub) {}
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue & operator=(const MpscQueue &) = delete;
+
+    void push(T * node) { push(static_cast<MpscQueueNode *>(node)); }
+
+    // Returns the oldest node or nullptr if the queue is empty.  Note that a
+    // push() which is still in progress may temporarily make the queue appear
+    // empty.
+    T * pop() {
+        MpscQueueNode * node = tail;
+        MpscQueueNode * next = node->next.load(std::memory_order_acquire);
+
+        if (node == &stub) {
+            if (!next) {
+                return nullptr;
+            }
+            tail = next;
+            node = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            tail = next;
+            return static_cast<T *>(node);
+        }
+
+        if (node != head.load(std::memory_order_acquire)) {
+            // a producer is in the middle of a push
+            return nullptr;
+        }
+
+        push(&stub);
+
+        next = node->next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return static_cast<T *>(node);
+        }
+
+        return nullptr;
+    }
+
+protected:
+    void push(MpscQueueNode * node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscQueueNode * prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    std::atomic<MpscQueueNode *> head;
+    MpscQueueNode * tail;
+    MpscQueueNode stub;
+};
+
+// Queue of whole outgoing messages.  Messages can be pushed from any task,
+// thread or core without locking.  The task owning the websocket calls send()
+// periodically to write them out.  Each message is written in one go, so
+// fragments of different messages are never interleaved.
+class MessageQueue {
+public:
+    // max_size limits the total payload size of queued messages, 0 means no
+    // limit.  If memory_budget is set, queued messages are accounted there
+    // too.
+    MessageQueue(size_t max_size = 0, MemoryBudget * memory_budget = nullptr)
+        : max_size(max_size), memory_budget(memory_budget), size(0) {}
+    ~MessageQueue() {
+        while (Message * message = queue.pop()) {
+            destroy(message);
+        }
+    }
+
+    // Copy a message into the queue.  Returns false if the message doesn't
+    // fit or if memory allocation fails.
+    // NOTE: The queue itself is lock-free, but the memory allocator may not be.
+    bool push(const void * payload, size_t length, bool bin = true) {
+        const size_t new_size =
+            size.fetch_add(length, std::memory_order_relaxed) + length;
+        if (max_size && (new_size > max_size)) {
+            size.fetch_sub(length, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (memory_budget &&
+            !memory_budget->acquire(sizeof(Message) + length)) {
+            size.fetch_sub(length, std::memory_order_relaxed);
+            return false;
+        }
+
+        void * memory = malloc(sizeof(Message) + length);
+        if (!memory) {
+            if (memory_budget) {
+                memory_budget->release(sizeof(Message) + length);
+            }
+            size.fetch_sub(length, std::memory_order_relaxed);
+            return false;
+        }
+
+        Message * message = new (memory) Message(length, bin);
+        memcpy(message->payload(), payload, length);
+        queue.push(message);
+        return true;
+    }
+
+    // Write queued messages to websocket, at most max_messages of them.  This
+    // must only be called by the task which owns websocket.  Nothing is sent
+    // while the application is in the middle of writing a fragmented message.
+    // Returns the number of messages sent.
+    size_t send(ClientBase & websocket,
+                size_t max_messages = std::numeric_limits<size_t>::max()) {
+        if (websocket.write_continue) {
+            return 0;
+        }
+
+        size_t sent = 0;
+        while (sent < max_messages) {
+            Message * message = queue.pop();
+            if (!message) {
+                break;
+            }
+
+            const bool ok =
+                websocket.write(message->payload(), message->length, true,
+                                message->bin) == message->length;
+            destroy(message);
+
+            if (!ok) {
+                break;
+            }
+            ++sent;
+        }
+
+        return sent;
+    }
+
+    // total payload size of queued messages
+    size_t queued_size() const { return size.load(std::memory_order_relaxed); }
+
+    const size_t max_size;
+    MemoryBudget * const memory_budget;
+
+protected:
+    struct Message : public MpscQueueNode {
+        Message(size_t length, bool bin) : length(length), bin(bin) {}
+        uint8_t * payload() { return reinterpret_cast<uint8_t *>(this + 1); }
+
+        const size_t length;
+        const bool bin;
+    };
+
+    void destroy(Message * message) {
+        size.fetch_sub(message->length, std::memory_order_relaxed);
+        if (memory_budget) {
+            memory_budget->release(sizeof(Message) + message->length);
+        }
+        message->~Message();
+        free(message);
+    }
+
+    MpscQueue<Message> queue;
+    std::atomic<size_t> size;
+};
+
+}  // namespace PicoWebsocket
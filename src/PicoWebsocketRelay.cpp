@@ -0,0 +1,102 @@
+#include "PicoWebsocketRelay.h"
+
+namespace PicoWebsocket {
+
+size_t Relay::forward() {
+    const unsigned long bytes_before = bytes;
+
+    while (source.client.available() &&
+           (source.in_frame_pos >= source.in_frame_size)) {
+        if (destination.closing || !destination.connected()) {
+            // nowhere to send the data, leave it in the source socket
+            break;
+        }
+
+        const ClientBase::Opcode opcode = source.read_head();
+        if (opcode == ClientBase::Opcode::ERR) {
+            break;
+        }
+
+        if ((uint8_t)opcode & 0x8) {
+            // control frame, meant for the source connection itself
+            source.handle_control_frame(opcode);
+            continue;
+        }
+
+        source.in_message = !source.in_frame_fin;
+        if (!forward_frame(opcode)) {
+            break;
+        }
+    }
+
+    // coalesced pongs go out once everything available is processed
+    source.flush_control_replies();
+    return bytes - bytes_before;
+}
+
+bool Relay::forward_frame(ClientBase::Opcode opcode) {
+    if (destination.split_mode) {
+        // replies queued by the destination's reader go out between frames
+        destination.send_control_replies();
+    }
+
+    const bool fin = source.in_frame_fin;
+    const size_t size = source.in_frame_size;
+
+    destination.write_continue = !fin;
+    destination.write_head(opcode, fin, size);
+
+    // Both frames have the same size, so payload bytes have the same
+    // position in both of them and unmasking with one key and masking with
+    // the other is the same as applying both keys at once.
+    const uint32_t in_mask = source.is_client ? 0 : source.in_mask;
+    const uint32_t out_mask = destination.is_client ? destination.out_mask : 0;
+    const bool tapped = source.tap || destination.tap;
+
+    uint8_t buffer[PICOWEBSOCKET_RELAY_CHUNK_SIZE];
+    while (source.in_frame_pos < size) {
+        const size_t offset = source.in_frame_pos;
+        size_t chunk_size = size - offset;
+        if (chunk_size > sizeof(buffer)) {
+            chunk_size = sizeof(buffer);
+        }
+
+        if (!source.read_all(buffer, chunk_size, source.socket_timeout_ms)) {
+            // source lost or timed out, the destination frame can't be
+            // completed
+            destination.client.stop();
+            return false;
+        }
+        source.in_frame_pos += chunk_size;
+        source.last_received_ms = clock_millis();
+
+        if (tapped) {
+            // taps expect unmasked data, do it in two steps
+            if (in_mask) {
+                ClientBase::mask_payload(buffer, in_mask, chunk_size, offset);
+            }
+            if (source.tap) {
+                source.tap->on_frame_payload(false, buffer, chunk_size);
+            }
+            if (destination.tap) {
+                destination.tap->on_frame_payload(true, buffer, chunk_size);
+            }
+            if (out_mask) {
+                ClientBase::mask_payload(buffer, out_mask, chunk_size, offset);
+            }
+        } else if (in_mask != out_mask) {
+            ClientBase::mask_payload(buffer, in_mask ^ out_mask, chunk_size,
+                                     offset);
+        }
+
+        if (!destination.write_all(buffer, chunk_size)) {
+            return false;
+        }
+        bytes += chunk_size;
+    }
+
+    ++frames;
+    return true;
+}
+
+}  // namespace PicoWebsocket
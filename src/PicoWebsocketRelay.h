@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocket.h"
+
+namespace PicoWebsocket {
+
+// Forwards data frames from one connection to another, e.g. in a bridge which
+// accepts connections from devices and passes their messages on upstream.
+// Frames are forwarded one by one with their opcode, fin flag and size
+// unchanged.  The payload goes through a single small buffer: the incoming
+// mask is removed and the outgoing one applied in one pass, without
+// unmasking the data first.
+//
+//   PicoWebsocket::Relay uplink(device_websocket, upstream_websocket);
+//   PicoWebsocket::Relay downlink(upstream_websocket, device_websocket);
+//
+//   void loop() {
+//       uplink.forward();
+//       downlink.forward();
+//   }
+//
+// Control frames received from the source are handled as usual, i.e. pings
+// are answered and close frames confirmed on the source connection.  When one
+// side disconnects, the application should stop the other one.
+// NOTE: Relayed frames are not split according to the destination's
+// max_frame_size.  Don't read from the source or write to the destination
+// directly while relaying.
+class Relay {
+public:
+    Relay(ClientBase & source, ClientBase & destination)
+        : frames(0), bytes(0), source(source), destination(destination) {}
+
+    // Forward the frames which are available on the source, without waiting
+    // for more.  Once a frame's header is received, its payload is forwarded
+    // completely, waiting for it if needed, so that the destination never
+    // sees an incomplete frame.  Returns the number of payload bytes
+    // forwarded.
+    size_t forward();
+
+    // totals forwarded so far
+    unsigned long frames;
+    unsigned long bytes;
+
+protected:
+    bool forward_frame(ClientBase::Opcode opcode);
+
+    ClientBase & source;
+    ClientBase & destination;
+};
+
+}  // namespace PicoWebsocket
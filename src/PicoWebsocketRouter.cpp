@@ -0,0 +1,101 @@
+#include "PicoWebsocketRouter.h"
+
+namespace PicoWebsocket {
+
+Router::Node::~Node() {
+    while (children) {
+        Node * child = children;
+        children = child->next;
+        delete child;
+    }
+}
+
+void Router::add(const String & path, ServerInterface & endpoint) {
+    const bool wildcard = path.endsWith("*");
+    const String key = wildcard ? path.substring(0, path.length() - 1) : path;
+
+    Node * node = &root;
+    const char * pos = key.c_str();
+    while (*pos) {
+        Node * child = node->children;
+        while (child && (child->label[0] != *pos)) {
+            child = child->next;
+        }
+
+        if (!child) {
+            // nothing shares a prefix with the rest of the key
+            child = new Node(pos);
+            child->next = node->children;
+            node->children = child;
+            node = child;
+            break;
+        }
+
+        size_t common = 1;
+        while ((common < child->label.length()) &&
+               (pos[common] == child->label[common])) {
+            ++common;
+        }
+
+        if (common < child->label.length()) {
+            // the key diverges in the middle of the label, split the node
+            Node * tail = new Node(child->label.substring(common));
+            tail->children = child->children;
+            tail->exact = child->exact;
+            tail->prefix = child->prefix;
+
+            child->label = child->label.substring(0, common);
+            child->children = tail;
+            child->exact = nullptr;
+            child->prefix = nullptr;
+        }
+
+        node = child;
+        pos += common;
+    }
+
+    if (wildcard) {
+        node->prefix = &endpoint;
+    } else {
+        node->exact = &endpoint;
+    }
+}
+
+ServerInterface * Router::match(const char * url) const {
+    const Node * node = &root;
+    ServerInterface * best = root.prefix;
+
+    while (true) {
+        if ((*url == '\0') || (*url == '?')) {
+            // end of path reached
+            return node->exact ? node->exact : best;
+        }
+
+        const Node * child = node->children;
+        while (child && (child->label[0] != *url)) {
+            child = child->next;
+        }
+
+        if (!child) {
+            return best;
+        }
+
+        const char * label = child->label.c_str();
+        while (*label && (*label == *url)) {
+            ++label;
+            ++url;
+        }
+
+        if (*label) {
+            // url diverges in the middle of the label
+            return best;
+        }
+
+        node = child;
+        if (node->prefix) {
+            best = node->prefix;
+        }
+    }
+}
+
+}  // namespace PicoWebsocket
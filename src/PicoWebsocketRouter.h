@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocket.h"
+
+namespace PicoWebsocket {
+
+// Maps URLs to endpoints using a compact prefix tree.  Matching takes time
+// linear in the length of the URL and doesn't allocate any memory.
+class Router {
+public:
+    Router() : root("") {}
+    virtual ~Router() {}
+
+    Router(const Router &) = delete;
+    Router & operator=(const Router &) = delete;
+
+    // Register endpoint to handle path.  A trailing '*' makes the route match
+    // all URLs starting with the given prefix, e.g. "/logs/*".  Exact routes
+    // take precedence over prefix routes, longer prefixes take precedence
+    // over shorter ones.
+    void add(const String & path, ServerInterface & endpoint);
+
+    // Find the endpoint for url, the query string is ignored.  Returns nullptr
+    // if no route matches.
+    ServerInterface * match(const char * url) const;
+
+protected:
+    struct Node {
+        Node(const String & label)
+            : label(label),
+              children(nullptr),
+              next(nullptr),
+              exact(nullptr),
+              prefix(nullptr) {}
+        ~Node();
+
+        String label;
+        Node * children;
+        Node * next;
+
+        ServerInterface * exact;
+        ServerInterface * prefix;
+    };
+
+    Node root;
+};
+
+// Server which serves multiple endpoints.  Each endpoint is a ServerInterface
+// with its own subprotocol and callbacks:
+//
+//   PicoWebsocket::ServerInterface telemetry("telemetry");
+//   PicoWebsocket::RoutedServer<WiFiServer> websocket_server(server);
+//   websocket_server.add("/telemetry", telemetry);
+//
+// Connections to URLs without a matching route are rejected with 404.
+template <typename ServerSocket>
+class RoutedServer : public Server<ServerSocket>, public Router {
+public:
+    using Server<ServerSocket>::Server;
+
+    virtual ServerInterface * resolve(const String & url) override {
+        ServerInterface * endpoint = match(url.c_str());
+        return (endpoint && endpoint->check_url(url)) ? endpoint : nullptr;
+    }
+};
+
+}  // namespace PicoWebsocket
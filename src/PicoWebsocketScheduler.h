@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocket.h"
+
+namespace PicoWebsocket {
+
+// Deficit round robin scheduler for server connections.
+//
+// Polling all connections in a loop lets a client which floods data take
+// most of the time, while others wait.  FairScheduler hands each connection
+// with pending data a budget of `quantum` bytes per round.  Budget which is
+// not used up because a read was cut short carries over to the next round,
+// but only up to one quantum, so a connection gets at most two quanta in a
+// round even after it stalled for a while.  The budget is dropped once the
+// connection has no more data, so idle connections can't save up.
+// Starvation metrics are kept in each connection's `schedule` member.
+class FairScheduler {
+public:
+    FairScheduler(size_t quantum = 512) : quantum(quantum), rounds(0) {}
+
+    // Run a single round over clients, a container of ServerClient objects
+    // (e.g. std::list<Server<WiFiServer>::Client>).  handler is called as
+    // handler(client, budget) while the connection has data and budget left.
+    // It should read at most budget bytes and must return the number of bytes
+    // it consumed.  Returns the number of bytes consumed in this round.
+    template <typename Container, typename Handler>
+    size_t run(Container & clients, Handler handler) {
+        const unsigned long now = clock_millis();
+        size_t consumed_total = 0;
+
+        for (auto & client : clients) {
+            ServerClient & connection = client;
+            ScheduleStats & stats = connection.schedule;
+
+            if (!connection.available()) {
+                stats.deficit = 0;
+                stats.waiting_since = 0;
+                continue;
+            }
+
+            if (stats.deficit > quantum) {
+                stats.deficit = quantum;
+            }
+            stats.deficit += quantum;
+
+            while (stats.deficit && connection.available()) {
+                const size_t consumed = handler(client, stats.deficit);
+                if (!consumed) {
+                    // handler can't make progress now
+                    break;
+                }
+                stats.deficit -=
+                    (consumed < stats.deficit) ? consumed : stats.deficit;
+                stats.bytes_served += consumed;
+                consumed_total += consumed;
+            }
+
+            if (!connection.available()) {
+                // all served
+                stats.deficit = 0;
+                stats.waiting_since = 0;
+                continue;
+            }
+
+            // budget exhausted, the rest has to wait for the next round
+            ++stats.deferred_rounds;
+            if (!stats.waiting_since) {
+                stats.waiting_since = now ? now : 1;
+            }
+            const unsigned long wait_ms = now - stats.waiting_since;
+            if (wait_ms > stats.max_wait_ms) {
+                stats.max_wait_ms = wait_ms;
+            }
+        }
+
+        ++rounds;
+        return consumed_total;
+    }
+
+    // bytes granted to each connection per round
+    size_t quantum;
+
+    // number of rounds run so far
+    unsigned long rounds;
+};
+
+}  // namespace PicoWebsocket
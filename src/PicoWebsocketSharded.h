@@ -0,0 +1,249 @@
+#pragma once
+
+// Multi-threaded websocket server.
+//
+// A ShardedServer accepts connections on a single thread (the acceptor) and
+// hands each established connection over to one of N worker threads (shards).
+// Each shard owns its connections exclusively, so no locking is needed when
+// handling them.  Messages can be broadcast to all connections of all shards
+// from any thread.
+//
+// If the server's timers are set (before begin()), each shard tracks the
+// timeouts of its connections with a TimerWheel of its own, with the same
+// settings.  The server's wheel is only used during handshakes on the
+// acceptor thread.
+//
+// NOTE: Subclasses must call end() in their destructor.  The shards call the
+// subclass' callbacks until their threads are joined, which would be too late
+// in ~ShardedServer().
+
+#ifdef ESP8266
+#error "PicoWebsocketSharded.h requires thread support, which ESP8266 lacks"
+#endif
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "PicoWebsocket.h"
+#include "PicoWebsocketQueue.h"
+
+namespace PicoWebsocket {
+
+template <typename ServerSocket>
+class ShardedServer : public Server<ServerSocket> {
+public:
+    using Client = typename Server<ServerSocket>::Client;
+
+    class Shard {
+    public:
+        Shard(ShardedServer & server, size_t index)
+            : server(server), index(index), connections(0) {}
+
+        ~Shard() {
+            while (Handoff * handoff = handoffs.pop()) {
+                delete handoff;
+            }
+            while (Broadcast * broadcast = broadcasts.pop()) {
+                delete broadcast;
+            }
+        }
+
+        ShardedServer & server;
+        const size_t index;
+
+        // number of connections owned by the shard
+        std::atomic<size_t> connections;
+
+        // connections owned by the shard, only access from the shard's thread
+        std::list<Client> clients;
+
+    protected:
+        struct Handoff : public MpscQueueNode {
+            Handoff(const Client & client) : client(client) {}
+            Client client;
+        };
+
+        struct Broadcast : public MpscQueueNode {
+            Broadcast(const std::shared_ptr<const std::vector<uint8_t>> & data,
+                      bool bin)
+                : data(data), bin(bin) {}
+            std::shared_ptr<const std::vector<uint8_t>> data;
+            bool bin;
+        };
+
+        // Run a single iteration of the shard's event loop, returns true if
+        // there was anything to do.
+        bool loop() {
+            bool busy = false;
+
+            if (timers && timers->advance()) {
+                busy = true;
+            }
+
+            while (Handoff * handoff = handoffs.pop()) {
+                clients.push_back(handoff->client);
+                delete handoff;
+                clients.back().set_timers(timers.get());
+                server.on_connect(*this, clients.back());
+                busy = true;
+            }
+
+            while (Broadcast * broadcast = broadcasts.pop()) {
+                for (auto & client : clients) {
+                    client.write(broadcast->data->data(),
+                                 broadcast->data->size(), true,
+                                 broadcast->bin);
+                }
+                delete broadcast;
+                busy = true;
+            }
+
+            for (auto it = clients.begin(); it != clients.end();) {
+                if (!it->connected()) {
+                    server.on_disconnect(*this, *it);
+                    it = clients.erase(it);
+                    --connections;
+                    continue;
+                }
+
+                if (it->available()) {
+                    server.on_data(*this, *it);
+                    busy = true;
+                }
+
+                ++it;
+            }
+
+            return busy;
+        }
+
+        void run() {
+            if (server.timers) {
+                // TimerWheel is not thread-safe, each shard needs its own
+                timers.reset(new TimerWheel(server.timers->resolution_ms,
+                                            server.timers->slot_count));
+            }
+            while (server.running) {
+                if (!loop()) {
+                    // nothing to do, don't hog the core
+                    delay(1);
+                }
+            }
+            clients.clear();
+            timers.reset();
+            connections = 0;
+        }
+
+        std::unique_ptr<TimerWheel> timers;
+        MpscQueue<Handoff> handoffs;
+        MpscQueue<Broadcast> broadcasts;
+        std::thread thread;
+
+        friend class ShardedServer;
+    };
+
+    ShardedServer(ServerSocket & server, size_t shard_count = 2,
+                  const String & protocol = "",
+                  unsigned long socket_timeout_ms = 1000)
+        : Server<ServerSocket>(server, protocol, socket_timeout_ms),
+          running(false) {
+        for (size_t i = 0; i < (shard_count ? shard_count : 1); ++i) {
+            shards.emplace_back(new Shard(*this, i));
+        }
+    }
+
+    // Stops the shards, if the subclass hasn't done so already (see above).
+    virtual ~ShardedServer() { end(); }
+
+    // Start listening and start the worker threads.
+    void begin() {
+        Server<ServerSocket>::begin();
+        if (running) {
+            return;
+        }
+        running = true;
+        for (auto & shard : shards) {
+            shard->thread = std::thread([&shard] { shard->run(); });
+        }
+    }
+
+    // Stop the worker threads, all connections are dropped.
+    void end() {
+        running = false;
+        for (auto & shard : shards) {
+            if (shard->thread.joinable()) {
+                shard->thread.join();
+            }
+        }
+    }
+
+    // Accept a single connection and hand it over to the least loaded shard.
+    // This runs the websocket handshake, so it should be called periodically
+    // from the acceptor thread.  Returns true if a connection was accepted.
+    bool loop() {
+        auto client = this->accept();
+        if (!client) {
+            return false;
+        }
+
+        Shard * target = shards.front().get();
+        for (auto & shard : shards) {
+            if (shard->connections < target->connections) {
+                target = shard.get();
+            }
+        }
+
+        // the shard takes over the timeout
+        client.set_timers(nullptr);
+
+        ++target->connections;
+        target->handoffs.push(new typename Shard::Handoff(client));
+        return true;
+    }
+
+    // Send a message to all connections of all shards.  Can be called from any
+    // thread, the payload is copied only once and shared by all shards.
+    void broadcast(const void * payload, size_t size, bool bin = true) {
+        auto data = std::make_shared<const std::vector<uint8_t>>(
+            (const uint8_t *)payload, (const uint8_t *)payload + size);
+        for (auto & shard : shards) {
+            shard->broadcasts.push(new typename Shard::Broadcast(data, bin));
+        }
+    }
+
+    // number of connections owned by all shards
+    size_t shard_connections() const {
+        size_t ret = 0;
+        for (auto & shard : shards) {
+            ret += shard->connections;
+        }
+        return ret;
+    }
+
+    const std::vector<std::unique_ptr<Shard>> & get_shards() const {
+        return shards;
+    }
+
+protected:
+    // The callbacks below are called on the thread of the shard owning the
+    // connection.
+
+    // New connection handed over to shard.
+    virtual void on_connect(Shard & shard, Client & client) {}
+
+    // Data available on client.
+    virtual void on_data(Shard & shard, Client & client) = 0;
+
+    // Connection lost, client will be destroyed after this call.
+    virtual void on_disconnect(Shard & shard, Client & client) {}
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> running;
+};
+
+}  // namespace PicoWebsocket
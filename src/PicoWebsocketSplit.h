@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocket.h"
+
+namespace PicoWebsocket {
+
+// Full-duplex use of a single connection from two tasks (e.g. running on the
+// two cores of an ESP32) without a lock.  Creating a half switches the
+// connection to split mode, in which the read and write paths don't share any
+// mutable state: the reader never writes to the socket, replies to pings and
+// close frames are queued for the writer instead.
+//
+//   PicoWebsocket::ReadHalf reader(websocket);    // used by one task only
+//   PicoWebsocket::WriteHalf writer(websocket);   // used by the other task
+//
+// The writer sends queued replies before each frame, when idle it should call
+// flush() periodically.  The connection must be fully set up (connected or
+// accepted) before it's split and the websocket itself must not be used
+// directly afterwards.
+// NOTE: The underlying ::Client must support reading and writing from
+// different tasks at the same time.  If a tap is set on the connection, it's
+// called from both tasks.
+class ReadHalf : public Stream {
+public:
+    ReadHalf(ClientBase & websocket) : websocket(websocket) {
+        websocket.split_mode = true;
+    }
+
+    virtual int available() override { return websocket.available(); }
+    virtual int read() override { return websocket.read(); }
+    int read(uint8_t * buffer, size_t size) {
+        return websocket.read(buffer, size);
+    }
+    virtual int peek() override { return websocket.peek(); }
+
+    // reading only
+    virtual size_t write(uint8_t) override { return 0; }
+
+    size_t receive(MessageSink & sink) { return websocket.receive(sink); }
+    const uint8_t * view(size_t & size) { return websocket.view(size); }
+    void consume(size_t size) { websocket.consume(size); }
+    bool skip_frame() { return websocket.skip_frame(); }
+    bool skip_message() { return websocket.skip_message(); }
+
+    bool connected() { return websocket.connected(); }
+
+protected:
+    ClientBase & websocket;
+};
+
+class WriteHalf : public Print {
+public:
+    WriteHalf(ClientBase & websocket) : websocket(websocket) {
+        websocket.split_mode = true;
+    }
+
+    size_t write(const void * buffer, size_t size, bool fin, bool bin = true) {
+        return websocket.write(buffer, size, fin, bin);
+    }
+    virtual size_t write(const uint8_t * buffer, size_t size) override {
+        return websocket.write(buffer, size);
+    }
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+    using Print::write;
+
+    void ping(const void * payload = nullptr, size_t size = 0) {
+        websocket.send_control_replies();
+        websocket.ping(payload, size);
+    }
+
+    // Send replies queued by the reader and flush the socket.
+    void flush() {
+        websocket.send_control_replies();
+        websocket.flush();
+    }
+
+    // Start the close handshake.  The reader sees the connection end once
+    // the peer confirms.
+    void close(uint16_t code = 1000) {
+        websocket.send_control_replies();
+        if (!websocket.closing) {
+            websocket.close(code);
+        }
+    }
+
+    bool connected() { return websocket.connected(); }
+
+protected:
+    ClientBase & websocket;
+};
+
+}  // namespace PicoWebsocket
@@ -0,0 +1,114 @@
+#include "PicoWebsocketTimer.h"
+
+namespace PicoWebsocket {
+
+void Timer::schedule(TimerWheel & wheel, unsigned long delay_ms) {
+    cancel();
+    // round up, but make sure the timer doesn't expire in the current tick
+    const unsigned long ticks =
+        (delay_ms + wheel.resolution_ms - 1) / wheel.resolution_ms;
+    wheel.insert(*this, wheel.current_tick + (ticks ? ticks : 1));
+}
+
+void Timer::copy_deadline(const Timer & other) {
+    cancel();
+    if (other.wheel) {
+        other.wheel->insert(*this, other.expires);
+    }
+}
+
+void Timer::cancel() {
+    if (wheel) {
+        wheel->remove(*this);
+    }
+}
+
+TimerWheel::TimerWheel(unsigned long resolution_ms, size_t slot_count)
+    : resolution_ms(resolution_ms ? resolution_ms : 1),
+      slot_count(slot_count ? slot_count : 1),
+      slots(new Timer *[this->slot_count]()),
+      due(nullptr),
+      count(0),
+      start_ms(clock_millis()),
+      current_tick(0) {}
+
+TimerWheel::~TimerWheel() {
+    while (due) {
+        remove(*due);
+    }
+    for (size_t i = 0; i < slot_count; ++i) {
+        while (slots[i]) {
+            remove(*slots[i]);
+        }
+    }
+    delete[] slots;
+}
+
+void TimerWheel::insert(Timer & timer, unsigned long expires, bool due) {
+    timer.wheel = this;
+    timer.expires = expires;
+    timer.due = due;
+
+    Timer *& first = head(timer);
+    timer.prev = nullptr;
+    timer.next = first;
+    if (first) {
+        first->prev = &timer;
+    }
+    first = &timer;
+    ++count;
+}
+
+void TimerWheel::remove(Timer & timer) {
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        head(timer) = timer.next;
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    timer.wheel = nullptr;
+    timer.prev = timer.next = nullptr;
+    timer.due = false;
+    --count;
+}
+
+size_t TimerWheel::advance(unsigned long now) {
+    const unsigned long target_tick = (now - start_ms) / resolution_ms;
+
+    if (target_tick - current_tick > slot_count) {
+        // we're late, visiting every slot once is enough to catch up
+        current_tick = target_tick - slot_count;
+    }
+
+    size_t fired = 0;
+    while (current_tick != target_tick) {
+        ++current_tick;
+
+        // Timers further than one revolution ahead share the slot with the
+        // ones which are due now, only fire the latter.  Due timers are moved
+        // to a separate list first, as on_timeout() may schedule or cancel
+        // other timers.
+        Timer * timer = slots[current_tick % slot_count];
+        while (timer) {
+            Timer * next = timer->next;
+            if ((long)(timer->expires - current_tick) <= 0) {
+                remove(*timer);
+                insert(*timer, timer->expires, true);
+            }
+            timer = next;
+        }
+
+        while (due) {
+            Timer & expired = *due;
+            remove(expired);
+            expired.on_timeout();
+            ++fired;
+        }
+    }
+
+    return fired;
+}
+
+}  // namespace PicoWebsocket
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "PicoWebsocketClock.h"
+
+namespace PicoWebsocket {
+
+class TimerWheel;
+
+// Intrusive timer, see TimerWheel.  The timer is cancelled automatically when
+// destroyed.
+class Timer {
+public:
+    Timer()
+        : wheel(nullptr),
+          prev(nullptr),
+          next(nullptr),
+          expires(0),
+          due(false) {}
+    virtual ~Timer() { cancel(); }
+
+    Timer(const Timer &) = delete;
+    Timer & operator=(const Timer &) = delete;
+
+    // Call on_timeout() after delay_ms (rounded up to the wheel's
+    // resolution).  Reschedules the timer if it was already scheduled.
+    void schedule(TimerWheel & wheel, unsigned long delay_ms);
+
+    // Schedule the timer to expire at the same time as other.
+    void copy_deadline(const Timer & other);
+
+    void cancel();
+    bool scheduled() const { return wheel; }
+
+protected:
+    virtual void on_timeout() = 0;
+
+    TimerWheel * wheel;
+    Timer * prev;
+    Timer * next;
+    unsigned long expires;
+    bool due;
+
+    friend class TimerWheel;
+};
+
+// Hashed timer wheel.  Scheduling and cancelling timers takes constant time
+// and advance() only looks at the slots which became due, so thousands of
+// connection timeouts can be tracked without scanning all connections.
+// NOTE: Not thread-safe, use it from a single task only.
+class TimerWheel {
+public:
+    TimerWheel(unsigned long resolution_ms = 100, size_t slot_count = 64);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel & operator=(const TimerWheel &) = delete;
+
+    // Fire all timers which expired until now.  Should be called periodically
+    // from the main loop.  Returns the number of timers fired.
+    size_t advance(unsigned long now);
+    size_t advance() { return advance(clock_millis()); }
+
+    // number of scheduled timers
+    size_t size() const { return count; }
+
+    const unsigned long resolution_ms;
+    const size_t slot_count;
+
+protected:
+    void insert(Timer & timer, unsigned long expires, bool due = false);
+    void remove(Timer & timer);
+    Timer *& head(const Timer & timer) {
+        return timer.due ? due : slots[timer.expires % slot_count];
+    }
+
+    Timer ** slots;
+
+    // timers which expired and are about to fire
+    Timer * due;
+    size_t count;
+
+    // ticks are counted in resolution_ms since start_ms
+    const unsigned long start_ms;
+    unsigned long current_tick;
+
+    friend class Timer;
+};
+
+}  // namespace PicoWebsocket
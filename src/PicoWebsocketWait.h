@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+namespace PicoWebsocket {
+
+// Policy used by blocking operations (reading a frame, waiting for the
+// handshake or the close reply, writing) when the socket isn't ready.  wait()
+// should return once the socket may have become ready or after timeout_ms at
+// the latest; returning early is fine, the caller checks the socket and calls
+// wait() again.  attempt counts the consecutive waits of the current
+// operation, starting at 0.
+class WaitStrategy {
+public:
+    enum class Event : uint8_t { readable, writable };
+
+    virtual ~WaitStrategy() {}
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) = 0;
+};
+
+// Busy wait, lowest latency.
+class SpinWait : public WaitStrategy {
+public:
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override {}
+};
+
+// Let other tasks run between checks, this is the default.
+class YieldWait : public WaitStrategy {
+public:
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override {
+        yield();
+    }
+};
+
+// Sleep between checks, doubling the sleep time on every attempt up to
+// max_delay_ms.  The first few attempts only yield, so short waits stay fast.
+// Good for battery powered devices.
+class BackoffWait : public WaitStrategy {
+public:
+    BackoffWait(unsigned long max_delay_ms = 16) : max_delay_ms(max_delay_ms) {}
+
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override {
+        if (attempt < 4) {
+            yield();
+            return;
+        }
+        const unsigned int shift = attempt - 4;
+        unsigned long delay_ms =
+            (shift < 16) ? (1ul << shift) : max_delay_ms;
+        if (delay_ms > max_delay_ms) {
+            delay_ms = max_delay_ms;
+        }
+        if (delay_ms > timeout_ms) {
+            delay_ms = timeout_ms;
+        }
+        delay(delay_ms);
+    }
+
+    unsigned long max_delay_ms;
+};
+
+#if defined(ESP32)
+// Block the waiting task on its FreeRTOS task notification.  Call notify()
+// (or notify_from_isr()) when data arrives, e.g. from a network event
+// handler.  Since most sockets don't signal readiness, the task also wakes up
+// every poll_interval_ms to check the socket.
+// NOTE: Only one task can wait on a NotifyWait at a time.
+class NotifyWait : public WaitStrategy {
+public:
+    NotifyWait(unsigned long poll_interval_ms = 10)
+        : poll_interval_ms(poll_interval_ms), task(nullptr) {}
+
+    virtual void wait(::Client & client, Event event, unsigned long timeout_ms,
+                      unsigned int attempt) override {
+        task = xTaskGetCurrentTaskHandle();
+        const unsigned long wait_ms =
+            timeout_ms < poll_interval_ms ? timeout_ms : poll_interval_ms;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    }
+
+    void notify() {
+        TaskHandle_t waiting = task;
+        if (waiting) {
+            xTaskNotifyGive(waiting);
+        }
+    }
+
+    void notify_from_isr() {
+        TaskHandle_t waiting = task;
+        if (waiting) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(waiting, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+    }
+
+    unsigned long poll_interval_ms;
+
+protected:
+    volatile TaskHandle_t task;
+};
+#endif
+
+}  // namespace PicoWebsocket
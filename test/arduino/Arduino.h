@@ -0,0 +1,232 @@
+#pragma once
+
+// Minimal Arduino core for running the tests on the host (env:native).  Only
+// what the library uses is provided.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <thread>
+
+inline unsigned long micros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+inline unsigned long millis() { return micros() / 1000; }
+
+inline void yield() { std::this_thread::yield(); }
+
+inline void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline long random() { return ::rand(); }
+
+#define F(x) (x)
+
+class String {
+public:
+    String() {}
+    String(const char * str) : str(str ? str : "") {}
+    String(const std::string & str) : str(str) {}
+    String(int value) : str(std::to_string(value)) {}
+    String(unsigned int value) : str(std::to_string(value)) {}
+    String(long value) : str(std::to_string(value)) {}
+    String(unsigned long value) : str(std::to_string(value)) {}
+
+    unsigned int length() const { return str.length(); }
+    const char * c_str() const { return str.c_str(); }
+    bool reserve(unsigned int size) {
+        str.reserve(size);
+        return true;
+    }
+
+    char operator[](unsigned int index) const { return str[index]; }
+    char charAt(unsigned int index) const { return str[index]; }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        return position(str.find(c, from));
+    }
+    int indexOf(const String & s, unsigned int from = 0) const {
+        return position(str.find(s.str, from));
+    }
+
+    String substring(unsigned int from) const {
+        return substring(from, str.length());
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        if (from > str.length()) {
+            return String();
+        }
+        return String(str.substr(from, to - from));
+    }
+
+    bool startsWith(const String & s) const { return str.rfind(s.str, 0) == 0; }
+    bool endsWith(const String & s) const {
+        return (str.length() >= s.str.length()) &&
+               !str.compare(str.length() - s.str.length(), s.str.length(),
+                            s.str);
+    }
+
+    void trim() {
+        const size_t first = str.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            str.clear();
+            return;
+        }
+        const size_t last = str.find_last_not_of(" \t\r\n");
+        str = str.substr(first, last - first + 1);
+    }
+
+    void toLowerCase() {
+        for (char & c : str) {
+            c = tolower(c);
+        }
+    }
+
+    long toInt() const { return atol(str.c_str()); }
+
+    void remove(unsigned int index) {
+        if (index < str.length()) {
+            str.erase(index);
+        }
+    }
+
+    bool operator==(const String & s) const { return str == s.str; }
+    bool operator==(const char * s) const { return str == s; }
+    bool operator!=(const String & s) const { return str != s.str; }
+    bool operator!=(const char * s) const { return str != s; }
+
+    String & operator+=(const String & s) {
+        str += s.str;
+        return *this;
+    }
+    String & operator+=(char c) {
+        str += c;
+        return *this;
+    }
+
+    friend String operator+(const String & a, const String & b) {
+        return String(a.str + b.str);
+    }
+    friend String operator+(const String & a, const char * b) {
+        return String(a.str + b);
+    }
+
+protected:
+    static int position(size_t pos) {
+        return (pos == std::string::npos) ? -1 : pos;
+    }
+
+    std::string str;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t * buffer, size_t size) {
+        size_t written = 0;
+        while (size--) {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+    size_t write(const char * str) {
+        return write((const uint8_t *)str, strlen(str));
+    }
+    size_t write(const char * buffer, size_t size) {
+        return write((const uint8_t *)buffer, size);
+    }
+
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char * str) { return write(str); }
+    size_t print(const String & str) { return write(str.c_str()); }
+    size_t println(const char * str) { return print(str) + print("\r\n"); }
+    size_t println(const String & str) { return println(str.c_str()); }
+
+    size_t printf(const char * format, ...)
+        __attribute__((format(printf, 2, 3))) {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        const int size = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (size < 0) {
+            return 0;
+        }
+        return write((const uint8_t *)buffer,
+                     (size_t)size < sizeof(buffer) ? size : sizeof(buffer) - 1);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char * buffer, size_t size) {
+        size_t count = 0;
+        while (count < size) {
+            const int c = read();
+            if (c < 0) {
+                break;
+            }
+            buffer[count++] = c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t * buffer, size_t size) {
+        return readBytes((char *)buffer, size);
+    }
+};
+
+class IPAddress {
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : octets{a, b, c, d} {}
+
+    uint8_t operator[](int index) const { return octets[index]; }
+
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", octets[0], octets[1],
+                 octets[2], octets[3]);
+        return String(buffer);
+    }
+
+protected:
+    uint8_t octets[4];
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+
+    virtual size_t write(uint8_t c) override {
+        return fwrite(&c, 1, 1, stdout);
+    }
+    virtual int available() override { return 0; }
+    virtual int read() override { return -1; }
+    virtual int peek() override { return -1; }
+};
+
+inline HardwareSerial Serial;
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Arduino.h"
+
+// SHA-1, as provided by the ESP8266 core.
+inline void sha1(const String & text, uint8_t * hash) {
+    auto rotate = [](uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    };
+
+    std::string message(text.c_str(), text.length());
+    const uint64_t bit_length = (uint64_t)message.length() * 8;
+    message += (char)0x80;
+    while (message.length() % 64 != 56) {
+        message += (char)0;
+    }
+    for (int i = 7; i >= 0; --i) {
+        message += (char)(bit_length >> (i * 8));
+    }
+
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                     0xC3D2E1F0};
+
+    for (size_t chunk = 0; chunk < message.length(); chunk += 64) {
+        const uint8_t * data = (const uint8_t *)message.data() + chunk;
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = data[4 * i] << 24 | data[4 * i + 1] << 16 |
+                   data[4 * i + 2] << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            const uint32_t temp = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            hash[i * 4 + j] = h[i] >> (24 - 8 * j);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Arduino.h"
+
+class base64 {
+public:
+    static String encode(const uint8_t * data, size_t size) {
+        static const char alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string ret;
+        for (size_t i = 0; i < size; i += 3) {
+            const size_t remaining = size - i;
+            uint32_t value = data[i] << 16;
+            if (remaining > 1) {
+                value |= data[i + 1] << 8;
+            }
+            if (remaining > 2) {
+                value |= data[i + 2];
+            }
+            ret += alphabet[(value >> 18) & 63];
+            ret += alphabet[(value >> 12) & 63];
+            ret += (remaining > 1) ? alphabet[(value >> 6) & 63] : '=';
+            ret += (remaining > 2) ? alphabet[value & 63] : '=';
+        }
+        return String(ret);
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+// Websocket server and clients connected through an emulated network, so
+// tests run on virtual time and don't depend on the host's timing.
+
+#include <PicoWebsocket.h>
+#include <PicoWebsocketEmulator.h>
+#include <unity.h>
+
+#include <list>
+
+template <typename ServerType>
+struct BasicEmulated {
+    using Server = ServerType;
+
+    BasicEmulated() : server_socket(network, 80), server(server_socket) {
+        network.upstream.latency_us = 10000;
+        network.downstream.latency_us = 10000;
+        server_socket.begin();
+        server.wait_strategy = &network;
+    }
+
+    // Open websocket, which must be created on a socket of this network.
+    // Returns the server side of the connection, nullptr if the handshake
+    // failed.
+    typename Server::Client * open(PicoWebsocket::Client & websocket) {
+        using ConnectState = PicoWebsocket::Client::ConnectState;
+
+        websocket.wait_strategy = &network;
+        websocket.start_connect("server", 80);
+
+        bool accepted = false;
+        while (websocket.poll_connect() != ConnectState::open) {
+            if (websocket.get_connect_state() == ConnectState::failed) {
+                return nullptr;
+            }
+            // the server's handshake blocks until the request arrives
+            if (!accepted && (websocket.get_connect_state() ==
+                              ConnectState::request_sent)) {
+                connections.push_back(server.accept());
+                accepted = true;
+            }
+            if (!network.step()) {
+                network.advance_ms(1);
+            }
+        }
+
+        return accepted ? &connections.back() : nullptr;
+    }
+
+    // Like open(), but the handshake must succeed.
+    typename Server::Client & connect(PicoWebsocket::Client & websocket) {
+        typename Server::Client * connection = open(websocket);
+        TEST_ASSERT_NOT_NULL(connection);
+        return *connection;
+    }
+
+    // Deliver everything in flight, calling poll() after each delivery.
+    template <typename Poll>
+    void run(Poll poll) {
+        do {
+            poll();
+        } while (network.step());
+        poll();
+    }
+
+    PicoWebsocket::Emulator::Network network;
+    PicoWebsocket::Emulator::Server server_socket;
+    Server server;
+    std::list<typename Server::Client> connections;
+};
+
+using Emulated = BasicEmulated<
+    PicoWebsocket::Server<PicoWebsocket::Emulator::Server>>;
@@ -0,0 +1,149 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+// Records the payload sizes of outgoing data frames.
+struct OutgoingFrames : public PicoWebsocket::FrameTap {
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override {
+        if (outgoing && !(opcode & 0x08)) {
+            sizes.push_back(payload_length);
+        }
+    }
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override {}
+
+    std::vector<size_t> sizes;
+};
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    return data;
+}
+
+// Write data from the server in one call and check that the client receives
+// all of it.
+void send_and_check(Emulated & emulated, PicoWebsocket::Client & websocket,
+                    PicoWebsocket::ServerClient & connection,
+                    const std::vector<uint8_t> & data) {
+    TEST_ASSERT_EQUAL(data.size(), connection.write(data.data(), data.size()));
+
+    std::vector<uint8_t> received;
+    emulated.run([&] {
+        uint8_t buffer[1024];
+        int size;
+        while ((size = websocket.read(buffer, sizeof(buffer))) > 0) {
+            received.insert(received.end(), buffer, buffer + size);
+        }
+    });
+    TEST_ASSERT_EQUAL(data.size(), received.size());
+    TEST_ASSERT_TRUE(received == data);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_disabled_by_default() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+
+    send_and_check(emulated, websocket, connection, pattern(100000));
+    TEST_ASSERT_EQUAL(1, frames.sizes.size());
+}
+
+void test_grows_on_free_link() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.adaptive_framing = true;
+
+    send_and_check(emulated, websocket, connection, pattern(300000));
+
+    // the frames double up to the limit, never shrinking
+    TEST_ASSERT_EQUAL(PICOWEBSOCKET_ADAPTIVE_FRAME_SIZE_LIMIT,
+                      connection.get_adaptive_frame_size());
+    TEST_ASSERT_EQUAL(1024, frames.sizes.front());
+    for (size_t i = 1; i + 1 < frames.sizes.size(); ++i) {
+        TEST_ASSERT_TRUE(frames.sizes[i] >= frames.sizes[i - 1]);
+    }
+}
+
+void test_shrinks_on_congested_link() {
+    Emulated emulated;
+    // the send buffer only takes a fraction of a frame at a time
+    emulated.network.downstream.send_buffer = 256;
+    emulated.network.downstream.bandwidth = 100000;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.adaptive_framing = true;
+    connection.min_frame_size = 200;
+
+    send_and_check(emulated, websocket, connection, pattern(20000));
+
+    // settles at a frame per wait, bounded by min_frame_size
+    const size_t size = connection.get_adaptive_frame_size();
+    TEST_ASSERT_TRUE(size < 1024);
+    TEST_ASSERT_TRUE(size >= 200);
+    TEST_ASSERT_TRUE(frames.sizes.back() <= 1024);
+}
+
+void test_bounded_by_max_frame_size() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.adaptive_framing = true;
+    connection.max_frame_size = 4096;
+
+    send_and_check(emulated, websocket, connection, pattern(100000));
+
+    TEST_ASSERT_EQUAL(4096, connection.get_adaptive_frame_size());
+    for (size_t size : frames.sizes) {
+        TEST_ASSERT_TRUE(size <= 4096);
+    }
+}
+
+void test_bounded_by_min_frame_size() {
+    Emulated emulated;
+    emulated.network.downstream.send_buffer = 64;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.adaptive_framing = true;
+    connection.min_frame_size = 512;
+
+    send_and_check(emulated, websocket, connection, pattern(20000));
+
+    TEST_ASSERT_EQUAL(512, connection.get_adaptive_frame_size());
+    for (size_t i = 0; i + 1 < frames.sizes.size(); ++i) {
+        TEST_ASSERT_TRUE(frames.sizes[i] >= 512);
+    }
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_disabled_by_default);
+    RUN_TEST(test_grows_on_free_link);
+    RUN_TEST(test_shrinks_on_congested_link);
+    RUN_TEST(test_bounded_by_max_frame_size);
+    RUN_TEST(test_bounded_by_min_frame_size);
+    return UNITY_END();
+}
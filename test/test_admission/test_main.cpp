@@ -0,0 +1,179 @@
+#include <PicoWebsocketAsync.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <list>
+#include <string>
+
+using AsyncServer =
+    PicoWebsocket::Async::Server<PicoWebsocket::Emulator::Server>;
+
+// Everything the peer sent on socket until it disconnected.
+std::string receive_all(PicoWebsocket::Emulator::Network & network,
+                        PicoWebsocket::Emulator::Client & socket) {
+    while (network.step()) {
+    }
+    std::string received;
+    uint8_t buffer[64];
+    int size;
+    while ((size = socket.read(buffer, sizeof(buffer))) > 0) {
+        received.append((const char *)buffer, size);
+    }
+    return received;
+}
+
+// Open a TCP connection and let the server accept it.  Nothing is sent, the
+// admission checks must not depend on the request.
+void connect_raw(Emulated & emulated,
+                 PicoWebsocket::Emulator::Client & socket) {
+    TEST_ASSERT_TRUE(socket.connect("server", 80));
+    emulated.connections.push_back(emulated.server.accept());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_connection_limit() {
+    Emulated emulated;
+    emulated.server.max_connections = 2;
+    PicoWebsocket::Emulator::Client sockets[3] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/"), b(sockets[1], "/");
+    emulated.connect(a);
+    emulated.connect(b);
+    TEST_ASSERT_EQUAL(2, emulated.server.get_connections());
+
+    // over the limit, answered right away
+    const uint64_t start_us = emulated.network.now_us();
+    connect_raw(emulated, sockets[2]);
+    TEST_ASSERT_TRUE(emulated.network.now_us() - start_us < 100000);
+    TEST_ASSERT_EQUAL_STRING(
+        "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n",
+        receive_all(emulated.network, sockets[2]).c_str());
+    TEST_ASSERT_FALSE(sockets[2].connected());
+    TEST_ASSERT_EQUAL(1, emulated.server.get_rejected());
+    TEST_ASSERT_EQUAL(2, emulated.server.get_connections());
+
+    // a slot opens up once a connection is destroyed
+    emulated.connections.pop_front();
+    TEST_ASSERT_EQUAL(1, emulated.server.get_connections());
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client c(socket, "/");
+    emulated.connect(c);
+    TEST_ASSERT_EQUAL(2, emulated.server.get_connections());
+}
+
+void test_reject_silently() {
+    Emulated emulated;
+    emulated.server.max_connections = 1;
+    emulated.server.reject_silently = true;
+    PicoWebsocket::Emulator::Client sockets[2] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/");
+    emulated.connect(a);
+
+    connect_raw(emulated, sockets[1]);
+    TEST_ASSERT_EQUAL_STRING("",
+                             receive_all(emulated.network, sockets[1]).c_str());
+    TEST_ASSERT_FALSE(sockets[1].connected());
+    TEST_ASSERT_EQUAL(1, emulated.server.get_rejected());
+}
+
+void test_handshake_fails_when_rejected() {
+    Emulated emulated;
+    emulated.server.max_connections = 1;
+    PicoWebsocket::Emulator::Client sockets[2] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/"), b(sockets[1], "/");
+    emulated.connect(a);
+    TEST_ASSERT_NULL(emulated.open(b));
+    TEST_ASSERT_FALSE(b.connected());
+}
+
+void test_token_bucket() {
+    Emulated emulated;
+    emulated.server.accept_rate = 2;
+    emulated.server.accept_burst = 3;
+    std::list<PicoWebsocket::Emulator::Client> sockets;
+    std::list<PicoWebsocket::Client> websockets;
+    auto attempt = [&]() {
+        sockets.emplace_back(emulated.network);
+        websockets.emplace_back(sockets.back(), "/");
+        return emulated.open(websockets.back()) != nullptr;
+    };
+
+    // a burst is admitted, the rest is rejected until tokens are refilled
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_TRUE(attempt());
+    }
+    TEST_ASSERT_FALSE(attempt());
+    TEST_ASSERT_EQUAL(1, emulated.server.get_rejected());
+
+    emulated.network.advance_ms(500);
+    TEST_ASSERT_TRUE(attempt());
+    TEST_ASSERT_FALSE(attempt());
+
+    // the bucket never holds more than a burst
+    emulated.network.advance_ms(10000);
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_TRUE(attempt());
+    }
+    TEST_ASSERT_FALSE(attempt());
+    TEST_ASSERT_EQUAL(3, emulated.server.get_rejected());
+}
+
+PicoWebsocket::Async::Task<void> accept_forever(AsyncServer & server) {
+    while (true) {
+        co_await server.accept();
+    }
+}
+
+void test_pending_handshake_limit() {
+    // with the coroutine API, handshakes proceed concurrently
+    PicoWebsocket::Emulator::Network network;
+    PicoWebsocket::Emulator::Server server_socket(network, 80);
+    PicoWebsocket::Async::PollingReactor reactor;
+    AsyncServer server(reactor, server_socket);
+    server.max_pending_handshakes = 1;
+    server.begin();
+    accept_forever(server).detach();
+
+    PicoWebsocket::Emulator::Client sockets[2] = {
+        PicoWebsocket::Emulator::Client(network),
+        PicoWebsocket::Emulator::Client(network),
+    };
+
+    // the first client never sends its request
+    TEST_ASSERT_TRUE(sockets[0].connect("server", 80));
+    reactor.poll();
+    TEST_ASSERT_EQUAL(1, server.get_pending_handshakes());
+
+    TEST_ASSERT_TRUE(sockets[1].connect("server", 80));
+    for (int i = 0; i < 10; ++i) {
+        reactor.poll();
+        network.step();
+    }
+    uint8_t buffer[64];
+    const int size = sockets[1].read(buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(size > 12);
+    TEST_ASSERT_EQUAL_MEMORY("HTTP/1.1 503", buffer, 12);
+    TEST_ASSERT_EQUAL(1, server.get_rejected());
+    TEST_ASSERT_EQUAL(1, server.get_pending_handshakes());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_connection_limit);
+    RUN_TEST(test_reject_silently);
+    RUN_TEST(test_handshake_fails_when_rejected);
+    RUN_TEST(test_token_bucket);
+    RUN_TEST(test_pending_handshake_limit);
+    return UNITY_END();
+}
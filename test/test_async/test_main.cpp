@@ -0,0 +1,196 @@
+#include <PicoWebsocketAsync.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <memory>
+#include <vector>
+
+using AsyncServer =
+    PicoWebsocket::Async::Server<PicoWebsocket::Emulator::Server>;
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Async echo server on the emulated network.
+struct EchoServer {
+    EchoServer() : server_socket(network, 80), server(reactor, server_socket) {
+        network.upstream.latency_us = 10000;
+        network.downstream.latency_us = 10000;
+        server.begin();
+        serve().detach();
+    }
+
+    PicoWebsocket::Async::Task<void> serve() {
+        connection = co_await server.accept();
+        PicoWebsocket::Async::Message message;
+        while (co_await connection->read_message(message)) {
+            ++messages;
+            co_await connection->write(message.data.data(),
+                                       message.data.size(), true,
+                                       message.binary);
+        }
+        closed = true;
+    }
+
+    void connect(PicoWebsocket::Client & websocket) {
+        using ConnectState = PicoWebsocket::Client::ConnectState;
+
+        websocket.wait_strategy = &network;
+        websocket.start_connect("server", 80);
+        while ((websocket.poll_connect() != ConnectState::open) ||
+               !connection) {
+            TEST_ASSERT_TRUE(websocket.get_connect_state() !=
+                             ConnectState::failed);
+            step();
+        }
+    }
+
+    // Resume the coroutines and let time pass.
+    void step() {
+        reactor.poll();
+        if (!network.step()) {
+            network.advance_ms(1);
+        }
+    }
+
+    PicoWebsocket::Emulator::Network network;
+    PicoWebsocket::Emulator::Server server_socket;
+    PicoWebsocket::Async::PollingReactor reactor;
+    AsyncServer server;
+    std::unique_ptr<AsyncServer::Client> connection;
+    unsigned int messages = 0;
+    bool closed = false;
+};
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    return data;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_echo() {
+    EchoServer echo;
+    PicoWebsocket::Emulator::Client socket(echo.network);
+    PongCounter websocket(socket, "/");
+    echo.connect(websocket);
+
+    // a fragmented message with a ping in between, then a short one
+    const std::vector<uint8_t> data = pattern(20000);
+    websocket.write(data.data(), 7000, false);
+    websocket.ping("p", 1);
+    websocket.write(data.data() + 7000, data.size() - 7000, true);
+    websocket.write((const uint8_t *)"hello", 5);
+
+    std::vector<uint8_t> received;
+    for (int i = 0; (i < 1000) && (received.size() < data.size() + 5); ++i) {
+        uint8_t buffer[512];
+        int size;
+        while ((size = websocket.read(buffer, sizeof(buffer))) > 0) {
+            received.insert(received.end(), buffer, buffer + size);
+        }
+        echo.step();
+    }
+
+    std::vector<uint8_t> expected = data;
+    expected.insert(expected.end(), {'h', 'e', 'l', 'l', 'o'});
+    TEST_ASSERT_EQUAL(2, echo.messages);
+    TEST_ASSERT_TRUE(received == expected);
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+}
+
+void test_close_from_client() {
+    EchoServer echo;
+    PicoWebsocket::Emulator::Client socket(echo.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    echo.connect(websocket);
+
+    websocket.begin_close(1000);
+    for (int i = 0; (i < 100) && !websocket.poll_close(); ++i) {
+        echo.step();
+    }
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    for (int i = 0; (i < 100) && !echo.closed; ++i) {
+        echo.step();
+    }
+    TEST_ASSERT_TRUE(echo.closed);
+    TEST_ASSERT_FALSE(echo.connection->connected());
+}
+
+void test_connection_lost() {
+    EchoServer echo;
+    PicoWebsocket::Emulator::Client socket(echo.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    echo.connect(websocket);
+
+    websocket.abort();
+    for (int i = 0; (i < 100) && !echo.closed; ++i) {
+        echo.step();
+    }
+    TEST_ASSERT_TRUE(echo.closed);
+    TEST_ASSERT_EQUAL(0, echo.messages);
+}
+
+void test_async_client() {
+    Emulated emulated;
+    PicoWebsocket::Async::PollingReactor reactor;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Async::Client websocket(reactor, socket, "/");
+
+    bool connected = false;
+    bool echoed = false;
+    auto run = [&]() -> PicoWebsocket::Async::Task<void> {
+        const char * host = "server";
+        connected = co_await websocket.connect(host, 80);
+        if (!connected) {
+            co_return;
+        }
+        const std::vector<uint8_t> data = {'p', 'i', 'n', 'g'};
+        co_await websocket.write(data.data(), data.size());
+        PicoWebsocket::Async::Message message;
+        echoed = co_await websocket.read_message(message) &&
+                 (message.data == data);
+    };
+    run().detach();
+
+    // the request is on its way, the blocking server can take it
+    emulated.connections.push_back(emulated.server.accept());
+    auto & connection = emulated.connections.back();
+    TEST_ASSERT_TRUE(connection.connected());
+
+    for (int i = 0; (i < 100) && !echoed; ++i) {
+        uint8_t buffer[16];
+        const int size = connection.read(buffer, sizeof(buffer));
+        if (size > 0) {
+            connection.write(buffer, size);
+        }
+        reactor.poll();
+        if (!emulated.network.step()) {
+            emulated.network.advance_ms(1);
+        }
+    }
+    TEST_ASSERT_TRUE(connected);
+    TEST_ASSERT_TRUE(echoed);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_echo);
+    RUN_TEST(test_close_from_client);
+    RUN_TEST(test_connection_lost);
+    RUN_TEST(test_async_client);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <PicoWebsocketCapture.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+// In-memory capture file.
+class Buffer : public Stream {
+public:
+    Buffer() : position(0) {}
+
+    virtual size_t write(uint8_t c) override { return write(&c, 1); }
+    virtual size_t write(const uint8_t * buffer, size_t size) override {
+        data.insert(data.end(), buffer, buffer + size);
+        return size;
+    }
+
+    virtual int available() override { return data.size() - position; }
+    virtual int read() override {
+        return (position < data.size()) ? data[position++] : -1;
+    }
+    virtual int peek() override {
+        return (position < data.size()) ? data[position] : -1;
+    }
+
+    std::vector<uint8_t> data;
+    size_t position;
+};
+
+// Everything the websocket reads until the capture is played back.
+std::string replay(PicoWebsocket::ReplayClient & replay_client,
+                   PicoWebsocket::ClientBase & websocket) {
+    std::string ret;
+    while (replay_client.connected() || websocket.available()) {
+        uint8_t buffer[256];
+        const int size = websocket.read(buffer, sizeof(buffer));
+        if (size > 0) {
+            ret.append((const char *)buffer, size);
+        }
+    }
+    return ret;
+}
+
+// Filled by test_record(), which runs first, and played back by the other
+// tests.
+const size_t frame_size = 16384;
+std::string large_message;
+Buffer server_capture;
+Buffer client_capture;
+
+void setUp() {}
+void tearDown() {}
+
+// Record both ends of a connection which exchanges a large fragmented
+// message, a short message and a reply.
+void test_record() {
+    large_message.resize(70000);
+    for (size_t i = 0; i < large_message.size(); ++i) {
+        large_message[i] = 'a' + i % 26;
+    }
+
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    PicoWebsocket::FrameRecorder server_recorder(server_capture);
+    PicoWebsocket::FrameRecorder client_recorder(client_capture);
+    connection.tap = &server_recorder;
+    websocket.tap = &client_recorder;
+
+    websocket.max_frame_size = frame_size;
+    websocket.write((const uint8_t *)large_message.c_str(),
+                    large_message.size());
+    websocket.write((const uint8_t *)"hi", 2);
+
+    std::string received;
+    emulated.run([&] {
+        uint8_t buffer[1024];
+        int size;
+        while ((size = connection.read(buffer, sizeof(buffer))) > 0) {
+            received.append((const char *)buffer, size);
+        }
+    });
+    TEST_ASSERT_TRUE(received == large_message + "hi");
+
+    connection.write((const uint8_t *)"reply", 5);
+    std::string reply;
+    emulated.run([&] {
+        uint8_t buffer[16];
+        int size;
+        while ((size = websocket.read(buffer, sizeof(buffer))) > 0) {
+            reply.append((const char *)buffer, size);
+        }
+    });
+    TEST_ASSERT_EQUAL_STRING("reply", reply.c_str());
+
+    TEST_ASSERT_TRUE(server_capture.data.size() > large_message.size());
+    TEST_ASSERT_EQUAL_MEMORY("PWSC\x01", server_capture.data.data(), 5);
+    TEST_ASSERT_EQUAL_MEMORY("PWSC\x01", client_capture.data.data(), 5);
+}
+
+void test_replay_to_server_side() {
+    server_capture.position = 0;
+    PicoWebsocket::ReplayClient replay_client(server_capture, true);
+    PicoWebsocket::ServerInterface endpoint;
+    PicoWebsocket::ServerClient websocket(replay_client, endpoint);
+
+    TEST_ASSERT_TRUE(replay(replay_client, websocket) == large_message + "hi");
+    TEST_ASSERT_TRUE(replay_client.finished());
+    TEST_ASSERT_EQUAL(large_message.size() + 2,
+                      replay_client.bytes_replayed);
+    // 5 fragments of the large message and the short one
+    TEST_ASSERT_EQUAL(6, replay_client.frames_replayed);
+}
+
+void test_replay_to_client_side() {
+    client_capture.position = 0;
+    PicoWebsocket::ReplayClient replay_client(client_capture, false);
+    PicoWebsocket::Client websocket(replay_client, "/");
+
+    TEST_ASSERT_EQUAL_STRING("reply",
+                             replay(replay_client, websocket).c_str());
+    TEST_ASSERT_EQUAL(1, replay_client.frames_replayed);
+}
+
+void test_replay_truncated_capture() {
+    // the capture ends in the first fragment, the missing part of its
+    // payload is padded
+    Buffer truncated;
+    truncated.data.assign(server_capture.data.begin(),
+                          server_capture.data.begin() + 1000);
+    PicoWebsocket::ReplayClient replay_client(truncated, true);
+    PicoWebsocket::ServerInterface endpoint;
+    PicoWebsocket::ServerClient websocket(replay_client, endpoint);
+
+    const std::string received = replay(replay_client, websocket);
+    TEST_ASSERT_EQUAL(frame_size, received.size());
+    TEST_ASSERT_TRUE(!large_message.compare(0, 900, received, 0, 900));
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_record);
+    RUN_TEST(test_replay_to_server_side);
+    RUN_TEST(test_replay_to_client_side);
+    RUN_TEST(test_replay_truncated_capture);
+    return UNITY_END();
+}
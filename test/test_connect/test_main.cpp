@@ -0,0 +1,174 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+using ConnectState = PicoWebsocket::Client::ConnectState;
+
+class StateRecorder : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    std::vector<ConnectState> states;
+
+protected:
+    virtual void on_connect_state(ConnectState state) override {
+        states.push_back(state);
+    }
+};
+
+// Poll until the connect is done, checking that polls never wait.  The
+// server accepts once the request is sent, unless accept is false.
+ConnectState poll_until_done(Emulated & emulated,
+                             PicoWebsocket::Client & websocket,
+                             bool accept = true) {
+    bool accepted = false;
+    while (true) {
+        const ConnectState before = websocket.get_connect_state();
+        const uint64_t start_us = emulated.network.now_us();
+        const ConnectState state = websocket.poll_connect();
+        if (before != ConnectState::connecting) {
+            // only the emulated TCP connect blocks
+            TEST_ASSERT_EQUAL(start_us, emulated.network.now_us());
+        }
+        if ((state == ConnectState::open) || (state == ConnectState::failed)) {
+            return state;
+        }
+        if (accept && !accepted && (state == ConnectState::request_sent)) {
+            emulated.connections.push_back(emulated.server.accept());
+            accepted = true;
+        }
+        if (!emulated.network.step()) {
+            emulated.network.advance_ms(1);
+        }
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_states_in_order() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    StateRecorder websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 80);
+    TEST_ASSERT_TRUE(websocket.get_connect_state() ==
+                     ConnectState::connecting);
+    TEST_ASSERT_FALSE(socket.connected());
+
+    TEST_ASSERT_TRUE(poll_until_done(emulated, websocket) ==
+                     ConnectState::open);
+
+    const std::vector<ConnectState> expected = {
+        ConnectState::connecting,      ConnectState::tcp_connected,
+        ConnectState::request_sent,    ConnectState::response_parsed,
+        ConnectState::open,
+    };
+    TEST_ASSERT_TRUE(websocket.states == expected);
+
+    // the connection is usable
+    websocket.write((const uint8_t *)"hi", 2);
+    auto & connection = emulated.connections.back();
+    uint8_t buffer[4];
+    int size = 0;
+    emulated.run([&] {
+        if (!size) {
+            size = connection.read(buffer, sizeof(buffer));
+        }
+    });
+    TEST_ASSERT_EQUAL(2, size);
+}
+
+void test_response_trickles_in() {
+    Emulated emulated;
+    // one byte per segment, a poll never sees a complete response at once
+    emulated.network.downstream.mss = 1;
+    emulated.network.downstream.bandwidth = 10000;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 80);
+    TEST_ASSERT_TRUE(poll_until_done(emulated, websocket) ==
+                     ConnectState::open);
+}
+
+void test_no_server() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    StateRecorder websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 81);
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::failed);
+    TEST_ASSERT_TRUE(websocket.states.back() == ConnectState::failed);
+
+    // failed is final
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::failed);
+}
+
+void test_timeout() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    // the server never answers
+    const uint64_t start_us = emulated.network.now_us();
+    websocket.start_connect("server", 80, 500);
+    TEST_ASSERT_TRUE(poll_until_done(emulated, websocket, false) ==
+                     ConnectState::failed);
+    TEST_ASSERT_FALSE(socket.connected());
+
+    const uint64_t elapsed_ms = (emulated.network.now_us() - start_us) / 1000;
+    TEST_ASSERT_TRUE(elapsed_ms >= 500);
+    TEST_ASSERT_TRUE(elapsed_ms < 600);
+}
+
+void test_rejected() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Server raw_server(emulated.network, 8080);
+    raw_server.begin();
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 8080);
+    while (websocket.poll_connect() != ConnectState::request_sent) {
+    }
+    PicoWebsocket::Emulator::Client peer = raw_server.accept();
+    const char response[] = "HTTP/1.1 404 Not Found\r\n\r\n";
+    peer.write((const uint8_t *)response, sizeof(response) - 1);
+
+    TEST_ASSERT_TRUE(poll_until_done(emulated, websocket, false) ==
+                     ConnectState::failed);
+    TEST_ASSERT_FALSE(socket.connected());
+}
+
+void test_retry_after_failure() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    StateRecorder websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 81);
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::failed);
+
+    websocket.start_connect("server", 80);
+    TEST_ASSERT_TRUE(poll_until_done(emulated, websocket) ==
+                     ConnectState::open);
+    TEST_ASSERT_TRUE(websocket.connected());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_states_in_order);
+    RUN_TEST(test_response_trickles_in);
+    RUN_TEST(test_no_server);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_rejected);
+    RUN_TEST(test_retry_after_failure);
+    return UNITY_END();
+}
@@ -0,0 +1,187 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Records the heads of outgoing frames.
+struct OutgoingFrames : public PicoWebsocket::FrameTap {
+    struct Head {
+        uint8_t opcode;
+        bool fin;
+        size_t length;
+    };
+
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override {
+        if (outgoing) {
+            heads.push_back(Head{opcode, fin, payload_length});
+        }
+    }
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override {}
+
+    std::vector<Head> heads;
+};
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    return data;
+}
+
+// Read everything the server sends.
+std::vector<uint8_t> receive_all(Emulated & emulated,
+                                 PicoWebsocket::Client & websocket) {
+    std::vector<uint8_t> received;
+    emulated.run([&] {
+        uint8_t buffer[512];
+        int size;
+        while ((size = websocket.read(buffer, sizeof(buffer))) > 0) {
+            received.insert(received.end(), buffer, buffer + size);
+        }
+    });
+    return received;
+}
+
+void check_head(const OutgoingFrames::Head & head, uint8_t opcode, bool fin,
+                size_t length) {
+    TEST_ASSERT_EQUAL_HEX8(opcode, head.opcode);
+    TEST_ASSERT_EQUAL(fin, head.fin);
+    TEST_ASSERT_EQUAL(length, head.length);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_large_write_fragmented() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.max_frame_size = 1000;
+
+    const std::vector<uint8_t> data = pattern(4500);
+    TEST_ASSERT_EQUAL(data.size(), connection.write(data.data(), data.size()));
+
+    TEST_ASSERT_EQUAL(5, frames.heads.size());
+    check_head(frames.heads[0], 0x2, false, 1000);
+    for (int i = 1; i < 4; ++i) {
+        check_head(frames.heads[i], 0x0, false, 1000);
+    }
+    check_head(frames.heads[4], 0x0, true, 500);
+
+    TEST_ASSERT_TRUE(receive_all(emulated, websocket) == data);
+}
+
+void test_small_write_not_fragmented() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.max_frame_size = 1000;
+
+    const std::vector<uint8_t> data = pattern(1000);
+    connection.write(data.data(), data.size(), true, false);
+
+    TEST_ASSERT_EQUAL(1, frames.heads.size());
+    check_head(frames.heads[0], 0x1, true, 1000);
+    TEST_ASSERT_TRUE(receive_all(emulated, websocket) == data);
+}
+
+void test_fragmented_writes_continue_message() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.max_frame_size = 1000;
+
+    const std::vector<uint8_t> data = pattern(2000);
+    connection.write(data.data(), 1500, false);
+    connection.write(data.data() + 1500, 500, true);
+
+    TEST_ASSERT_EQUAL(3, frames.heads.size());
+    check_head(frames.heads[0], 0x2, false, 1000);
+    check_head(frames.heads[1], 0x0, false, 500);
+    check_head(frames.heads[2], 0x0, true, 500);
+    TEST_ASSERT_TRUE(receive_all(emulated, websocket) == data);
+}
+
+void test_ping_answered_between_fragments() {
+    Emulated emulated;
+    // the write has to wait for the peer, so the ping arrives in the middle
+    emulated.network.downstream.send_buffer = 2048;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    OutgoingFrames frames;
+    connection.tap = &frames;
+    connection.max_frame_size = 1000;
+
+    websocket.ping("p", 1);
+    const std::vector<uint8_t> data = pattern(20000);
+    TEST_ASSERT_EQUAL(data.size(), connection.write(data.data(), data.size()));
+
+    // the pong went out between two data frames
+    size_t pong_index = 0;
+    for (size_t i = 0; i < frames.heads.size(); ++i) {
+        if (frames.heads[i].opcode == 0xa) {
+            pong_index = i;
+        }
+    }
+    TEST_ASSERT_EQUAL(21, frames.heads.size());
+    TEST_ASSERT_TRUE(pong_index > 0);
+    TEST_ASSERT_TRUE(pong_index < frames.heads.size() - 1);
+
+    TEST_ASSERT_TRUE(receive_all(emulated, websocket) == data);
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+}
+
+void test_close_ends_write() {
+    Emulated emulated;
+    emulated.network.downstream.send_buffer = 2048;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    connection.max_frame_size = 1000;
+
+    websocket.begin_close(1001);
+    const std::vector<uint8_t> data = pattern(20000);
+    const size_t written = connection.write(data.data(), data.size());
+    TEST_ASSERT_TRUE(written < data.size());
+    TEST_ASSERT_EQUAL(0, written % 1000);
+
+    // the close handshake completes, the data sent before is discarded
+    emulated.run([&] { websocket.poll_close(); });
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    TEST_ASSERT_FALSE(connection.connected());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_large_write_fragmented);
+    RUN_TEST(test_small_write_not_fragmented);
+    RUN_TEST(test_fragmented_writes_continue_message);
+    RUN_TEST(test_ping_answered_between_fragments);
+    RUN_TEST(test_close_ends_write);
+    return UNITY_END();
+}
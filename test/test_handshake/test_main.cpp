@@ -0,0 +1,74 @@
+#include <emulated.h>
+#include <unity.h>
+
+using ConnectState = PicoWebsocket::Client::ConnectState;
+
+void setUp() {}
+void tearDown() {}
+
+void test_handshake_in_single_writes() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/", "chat");
+    emulated.server.protocol = "chat";
+    websocket.wait_strategy = &emulated.network;
+
+    websocket.start_connect("server", 80);
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::tcp_connected);
+
+    // the request goes out in one segment
+    unsigned long segments = emulated.network.segments;
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::request_sent);
+    TEST_ASSERT_EQUAL(1, emulated.network.segments - segments);
+
+    // and so does the response
+    segments = emulated.network.segments;
+    emulated.connections.push_back(emulated.server.accept());
+    TEST_ASSERT_TRUE(emulated.connections.back().connected());
+    TEST_ASSERT_EQUAL(1, emulated.network.segments - segments);
+
+    while (websocket.poll_connect() != ConnectState::open) {
+        TEST_ASSERT_TRUE(emulated.network.step());
+    }
+}
+
+void test_timing() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    emulated.connect(websocket);
+
+    const PicoWebsocket::Client::Timing & timing = websocket.get_timing();
+
+    // the TCP handshake takes a round trip on the emulated network
+    TEST_ASSERT_TRUE(timing.tcp_connected >= 20000);
+    TEST_ASSERT_TRUE(timing.request_sent >= timing.tcp_connected);
+    // and so does the websocket handshake
+    TEST_ASSERT_TRUE(timing.response_received >= timing.request_sent + 20000);
+    TEST_ASSERT_TRUE(timing.handshake_complete >= timing.response_received);
+    TEST_ASSERT_TRUE(timing.handshake_complete < 100000);
+}
+
+void test_timing_of_failed_connect() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    websocket.wait_strategy = &emulated.network;
+
+    // nobody listens, phases which were not reached stay 0
+    websocket.start_connect("server", 81);
+    TEST_ASSERT_TRUE(websocket.poll_connect() == ConnectState::failed);
+    const PicoWebsocket::Client::Timing & timing = websocket.get_timing();
+    TEST_ASSERT_EQUAL(0, timing.tcp_connected);
+    TEST_ASSERT_EQUAL(0, timing.request_sent);
+    TEST_ASSERT_EQUAL(0, timing.response_received);
+    TEST_ASSERT_EQUAL(0, timing.handshake_complete);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_handshake_in_single_writes);
+    RUN_TEST(test_timing);
+    RUN_TEST(test_timing_of_failed_connect);
+    return UNITY_END();
+}
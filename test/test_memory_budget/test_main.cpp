@@ -0,0 +1,203 @@
+#include <PicoWebsocketAsync.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <memory>
+#include <vector>
+
+using AsyncServer =
+    PicoWebsocket::Async::Server<PicoWebsocket::Emulator::Server>;
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Async server on the emulated network, its coroutines are resumed between
+// the network's steps.
+struct AsyncEmulated {
+    AsyncEmulated()
+        : server_socket(network, 80), server(reactor, server_socket) {
+        network.upstream.latency_us = 10000;
+        network.downstream.latency_us = 10000;
+        server.memory_budget = &budget;
+        server.begin();
+    }
+
+    PicoWebsocket::Async::Task<void> accept() {
+        connection = co_await server.accept();
+    }
+
+    void connect(PicoWebsocket::Client & websocket) {
+        using ConnectState = PicoWebsocket::Client::ConnectState;
+
+        websocket.wait_strategy = &network;
+        websocket.start_connect("server", 80);
+        accept().detach();
+        while ((websocket.poll_connect() != ConnectState::open) ||
+               !connection) {
+            TEST_ASSERT_TRUE(websocket.get_connect_state() !=
+                             ConnectState::failed);
+            step();
+        }
+    }
+
+    // Resume the coroutines and let time pass.
+    void step() {
+        reactor.poll();
+        if (!network.step()) {
+            network.advance_ms(1);
+        }
+    }
+
+    PicoWebsocket::Emulator::Network network;
+    PicoWebsocket::Emulator::Server server_socket;
+    PicoWebsocket::Async::PollingReactor reactor;
+    PicoWebsocket::MemoryBudget budget{4096};
+    AsyncServer server;
+    std::unique_ptr<AsyncServer::Client> connection;
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_reads_pause_under_pressure() {
+    Emulated emulated;
+    PicoWebsocket::MemoryBudget budget(4096);
+    emulated.server.memory_budget = &budget;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    TEST_ASSERT_EQUAL(0, budget.used());
+
+    TEST_ASSERT_TRUE(budget.acquire(3500));
+    websocket.write((const uint8_t *)"hello", 5);
+    emulated.run([&] { TEST_ASSERT_EQUAL(0, connection.available()); });
+
+    // the message waits in the socket until memory is released
+    budget.release(3500);
+    uint8_t buffer[16];
+    TEST_ASSERT_EQUAL(5, connection.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("hello", buffer, 5);
+}
+
+void test_ping_answered_under_pressure() {
+    Emulated emulated;
+    PicoWebsocket::MemoryBudget budget(4096);
+    emulated.server.memory_budget = &budget;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    TEST_ASSERT_TRUE(budget.acquire(3500));
+    websocket.ping("a", 1);
+    emulated.run([&] {
+        connection.available();
+        websocket.available();
+    });
+
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+    TEST_ASSERT_TRUE(connection.connected());
+    budget.release(3500);
+}
+
+void test_close_completes_under_pressure() {
+    Emulated emulated;
+    PicoWebsocket::MemoryBudget budget(4096);
+    emulated.server.memory_budget = &budget;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    TEST_ASSERT_TRUE(budget.acquire(3500));
+    websocket.begin_close(1000);
+    emulated.run([&] {
+        uint8_t buffer[16];
+        connection.read(buffer, sizeof(buffer));
+        websocket.poll_close();
+    });
+
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    TEST_ASSERT_FALSE(connection.connected());
+    budget.release(3500);
+}
+
+void test_async_output_charged_until_sent() {
+    AsyncEmulated emulated;
+    // only a few segments fit in the send buffer at a time
+    emulated.network.downstream.send_buffer = 1024;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    emulated.connect(websocket);
+    TEST_ASSERT_EQUAL(0, emulated.budget.used());
+
+    const std::vector<uint8_t> data(3000, 0x42);
+    bool sent = false;
+    auto write = [&]() -> PicoWebsocket::Async::Task<void> {
+        sent = co_await emulated.connection->write(data.data(), data.size());
+    };
+    write().detach();
+
+    // the rest of the frame waits in the connection's output buffer
+    TEST_ASSERT_FALSE(sent);
+    TEST_ASSERT_TRUE(emulated.budget.used() >= data.size() - 1024);
+
+    size_t received = 0;
+    while (!sent || (received < data.size())) {
+        uint8_t buffer[512];
+        const int size = websocket.read(buffer, sizeof(buffer));
+        received += size > 0 ? size : 0;
+        emulated.step();
+    }
+    TEST_ASSERT_EQUAL(data.size(), received);
+    TEST_ASSERT_EQUAL(0, emulated.budget.used());
+}
+
+void test_async_ping_answered_under_pressure() {
+    AsyncEmulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    emulated.connect(websocket);
+
+    bool received = false;
+    auto read = [&]() -> PicoWebsocket::Async::Task<void> {
+        PicoWebsocket::Async::Message message;
+        received = co_await emulated.connection->read_message(message);
+    };
+    read().detach();
+
+    TEST_ASSERT_TRUE(emulated.budget.acquire(3500));
+    websocket.ping("a", 1);
+    websocket.write((const uint8_t *)"hello", 5);
+    for (int i = 0; i < 100; ++i) {
+        websocket.available();
+        emulated.step();
+    }
+
+    // the ping is answered, the message waits in the socket
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+    TEST_ASSERT_FALSE(received);
+
+    emulated.budget.release(3500);
+    for (int i = 0; (i < 100) && !received; ++i) {
+        emulated.step();
+    }
+    TEST_ASSERT_TRUE(received);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_reads_pause_under_pressure);
+    RUN_TEST(test_ping_answered_under_pressure);
+    RUN_TEST(test_close_completes_under_pressure);
+    RUN_TEST(test_async_output_charged_until_sent);
+    RUN_TEST(test_async_ping_answered_under_pressure);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <string>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+    std::string last_payload;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+        last_payload.assign((const char *)data, size);
+    }
+};
+
+// Deliver everything, the server only checks for incoming data.
+void exchange(Emulated & emulated, PongCounter & websocket,
+              PicoWebsocket::ServerClient & connection) {
+    emulated.run([&] {
+        connection.available();
+        websocket.available();
+    });
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_each_ping_answered_by_default() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    TEST_ASSERT_FALSE(connection.coalesce_pongs);
+
+    websocket.ping("a", 1);
+    websocket.ping("b", 1);
+    websocket.ping("c", 1);
+    exchange(emulated, websocket, connection);
+
+    TEST_ASSERT_EQUAL(3, websocket.pongs);
+    TEST_ASSERT_EQUAL_STRING("c", websocket.last_payload.c_str());
+}
+
+void test_burst_answered_once() {
+    Emulated emulated;
+    emulated.server.coalesce_pongs = true;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    for (int i = 0; i < 100; ++i) {
+        const std::string payload = "ping" + std::to_string(i);
+        websocket.ping(payload.c_str(), payload.length());
+    }
+    exchange(emulated, websocket, connection);
+
+    // the pong carries the payload of the last ping
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+    TEST_ASSERT_EQUAL_STRING("ping99", websocket.last_payload.c_str());
+}
+
+void test_pings_separated_by_data() {
+    Emulated emulated;
+    emulated.server.coalesce_pongs = true;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.ping("a", 1);
+    websocket.write((const uint8_t *)"x", 1);
+    websocket.ping("b", 1);
+
+    emulated.run([&] {
+        uint8_t buffer[16];
+        connection.read(buffer, sizeof(buffer));
+        websocket.available();
+    });
+
+    TEST_ASSERT_EQUAL(2, websocket.pongs);
+    TEST_ASSERT_EQUAL_STRING("b", websocket.last_payload.c_str());
+}
+
+void test_ping_followed_by_other_control_frame() {
+    // the queued pong must not wait for the next data frame
+    for (const bool coalesce : {false, true}) {
+        Emulated emulated;
+        emulated.server.coalesce_pongs = coalesce;
+        PicoWebsocket::Emulator::Client socket(emulated.network);
+        PongCounter websocket(socket, "/");
+        auto & connection = emulated.connect(websocket);
+
+        websocket.ping("a", 1);
+        websocket.pong("b", 1);
+        exchange(emulated, websocket, connection);
+
+        TEST_ASSERT_EQUAL(1, websocket.pongs);
+        TEST_ASSERT_EQUAL_STRING("a", websocket.last_payload.c_str());
+    }
+}
+
+void test_ping_answered_while_reading() {
+    Emulated emulated;
+    emulated.server.coalesce_pongs = true;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.ping("a", 1);
+    websocket.pong("b", 1);
+    emulated.run([&] {
+        uint8_t buffer[16];
+        connection.read(buffer, sizeof(buffer));
+        websocket.available();
+    });
+
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_each_ping_answered_by_default);
+    RUN_TEST(test_burst_answered_once);
+    RUN_TEST(test_pings_separated_by_data);
+    RUN_TEST(test_ping_followed_by_other_control_frame);
+    RUN_TEST(test_ping_answered_while_reading);
+    return UNITY_END();
+}
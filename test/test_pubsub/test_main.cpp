@@ -0,0 +1,113 @@
+#include <PicoWebsocketPubSub.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <string>
+
+void setUp() {}
+void tearDown() {}
+
+// Everything received by websocket so far.
+std::string received(Emulated & emulated, PicoWebsocket::Client & websocket) {
+    std::string ret;
+    emulated.run([&] {
+        uint8_t buffer[64];
+        int size;
+        while ((size = websocket.read(buffer, sizeof(buffer))) > 0) {
+            ret.append((const char *)buffer, size);
+        }
+    });
+    return ret;
+}
+
+void test_pubsub_delivery() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client sockets[3] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/"), b(sockets[1], "/"),
+        c(sockets[2], "/");
+    auto & server_a = emulated.connect(a);
+    auto & server_b = emulated.connect(b);
+    auto & server_c = emulated.connect(c);
+
+    PicoWebsocket::PubSub hub;
+    hub.subscribe("sensors/kitchen/temp", server_a);
+    hub.subscribe("sensors/kitchen/*", server_b);
+    hub.subscribe("sensors/*", server_c);
+    // overlapping subscriptions deliver once, duplicates are ignored
+    hub.subscribe("sensors/kitchen/temp", server_c);
+    hub.subscribe("sensors/kitchen/temp", server_c);
+    // splits a node of the tree
+    hub.subscribe("sensors/kit", server_a);
+    TEST_ASSERT_EQUAL(5, hub.subscriptions());
+
+    TEST_ASSERT_EQUAL(3, hub.publish("sensors/kitchen/temp", "1"));
+    TEST_ASSERT_EQUAL(2, hub.publish("sensors/kitchen/humidity", "2"));
+    TEST_ASSERT_EQUAL(1, hub.publish("sensors/garage", "3"));
+    TEST_ASSERT_EQUAL(2, hub.publish("sensors/kit", "4"));
+    TEST_ASSERT_EQUAL(1, hub.publish("sensors/kitchen", "5"));
+    TEST_ASSERT_EQUAL(0, hub.publish("other", "6"));
+
+    TEST_ASSERT_EQUAL_STRING("14", received(emulated, a).c_str());
+    TEST_ASSERT_EQUAL_STRING("12", received(emulated, b).c_str());
+    TEST_ASSERT_EQUAL_STRING("12345", received(emulated, c).c_str());
+}
+
+void test_pubsub_unsubscribe() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client sockets[2] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/"), b(sockets[1], "/");
+    auto & server_a = emulated.connect(a);
+    auto & server_b = emulated.connect(b);
+
+    PicoWebsocket::PubSub hub;
+    hub.subscribe("sensors/*", server_a);
+    hub.subscribe("sensors/kitchen", server_a);
+    hub.subscribe("sensors/*", server_b);
+    hub.subscribe("sensors/garage", server_b);
+
+    hub.unsubscribe("sensors/*", server_a);
+    TEST_ASSERT_EQUAL(3, hub.subscriptions());
+    TEST_ASSERT_EQUAL(1, hub.publish("sensors/garage", "1"));
+    TEST_ASSERT_EQUAL(2, hub.publish("sensors/kitchen", "2"));
+
+    hub.unsubscribe(server_b);
+    TEST_ASSERT_EQUAL(1, hub.subscriptions());
+    TEST_ASSERT_EQUAL(0, hub.publish("sensors/garage", "3"));
+    TEST_ASSERT_EQUAL(1, hub.publish("sensors/kitchen", "4"));
+
+    TEST_ASSERT_EQUAL_STRING("24", received(emulated, a).c_str());
+    TEST_ASSERT_EQUAL_STRING("12", received(emulated, b).c_str());
+}
+
+void test_pubsub_memory_budget() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    PicoWebsocket::MemoryBudget budget(1000);
+    PicoWebsocket::PubSub hub(&budget);
+    hub.subscribe("topic", connection);
+
+    const std::string message(200, 'x');
+    TEST_ASSERT_EQUAL(1, hub.publish("topic", String(message.c_str())));
+    TEST_ASSERT_TRUE(budget.high_water_mark() > message.length());
+    TEST_ASSERT_EQUAL(0, budget.used());
+    TEST_ASSERT_EQUAL_STRING(message.c_str(),
+                             received(emulated, websocket).c_str());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pubsub_delivery);
+    RUN_TEST(test_pubsub_unsubscribe);
+    RUN_TEST(test_pubsub_memory_budget);
+    return UNITY_END();
+}
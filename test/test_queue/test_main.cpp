@@ -0,0 +1,106 @@
+#include <PicoWebsocketQueue.h>
+#include <unity.h>
+
+#include <thread>
+#include <vector>
+
+using PicoWebsocket::MpscQueue;
+using PicoWebsocket::MpscQueueNode;
+
+struct Item : public MpscQueueNode {
+    Item(unsigned int producer = 0, unsigned int sequence = 0)
+        : producer(producer), sequence(sequence) {}
+    unsigned int producer;
+    unsigned int sequence;
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty_queue() {
+    MpscQueue<Item> queue;
+    TEST_ASSERT_NULL(queue.pop());
+    TEST_ASSERT_NULL(queue.pop());
+}
+
+void test_fifo_order() {
+    MpscQueue<Item> queue;
+    Item items[3] = {Item(0, 0), Item(0, 1), Item(0, 2)};
+    for (Item & item : items) {
+        queue.push(&item);
+    }
+
+    TEST_ASSERT_EQUAL_PTR(&items[0], queue.pop());
+    TEST_ASSERT_EQUAL_PTR(&items[1], queue.pop());
+    TEST_ASSERT_EQUAL_PTR(&items[2], queue.pop());
+    TEST_ASSERT_NULL(queue.pop());
+}
+
+void test_reuse_after_drain() {
+    MpscQueue<Item> queue;
+    Item a, b;
+
+    // the last node is only handed out once the stub is back in the queue
+    queue.push(&a);
+    TEST_ASSERT_EQUAL_PTR(&a, queue.pop());
+    TEST_ASSERT_NULL(queue.pop());
+
+    queue.push(&b);
+    queue.push(&a);
+    TEST_ASSERT_EQUAL_PTR(&b, queue.pop());
+    TEST_ASSERT_EQUAL_PTR(&a, queue.pop());
+    TEST_ASSERT_NULL(queue.pop());
+
+    queue.push(&b);
+    TEST_ASSERT_EQUAL_PTR(&b, queue.pop());
+    TEST_ASSERT_NULL(queue.pop());
+}
+
+void test_concurrent_producers() {
+    const unsigned int producer_count = 4;
+    const unsigned int item_count = 10000;
+
+    MpscQueue<Item> queue;
+    std::vector<Item> items(producer_count * item_count);
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&queue, &items, p] {
+            for (unsigned int i = 0; i < item_count; ++i) {
+                Item & item = items[p * item_count + i];
+                item.producer = p;
+                item.sequence = i;
+                queue.push(&item);
+            }
+        });
+    }
+
+    // every item arrives exactly once, in order per producer
+    std::vector<unsigned int> next(producer_count, 0);
+    unsigned int received = 0;
+    bool in_order = true;
+    while (received < producer_count * item_count) {
+        Item * item = queue.pop();
+        if (!item) {
+            std::this_thread::yield();
+            continue;
+        }
+        in_order = in_order && (item->sequence == next[item->producer]);
+        ++next[item->producer];
+        ++received;
+    }
+
+    for (std::thread & producer : producers) {
+        producer.join();
+    }
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_NULL(queue.pop());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_queue);
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_reuse_after_drain);
+    RUN_TEST(test_concurrent_producers);
+    return UNITY_END();
+}
@@ -0,0 +1,219 @@
+#include <PicoWebsocketRelay.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Records the heads of incoming data frames.
+struct IncomingFrames : public PicoWebsocket::FrameTap {
+    struct Head {
+        uint8_t opcode;
+        bool fin;
+        size_t length;
+    };
+
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override {
+        if (!outgoing && !(opcode & 0x08)) {
+            heads.push_back(Head{opcode, fin, payload_length});
+        }
+    }
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override {}
+
+    std::vector<Head> heads;
+};
+
+// Passes the payload on untouched, so that the relay takes the tapped path.
+struct NullTap : public PicoWebsocket::FrameTap {
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override {}
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override {
+        bytes += size;
+    }
+
+    size_t bytes = 0;
+};
+
+// Two clients connected to the same emulated server.  The device's server
+// side connection and the uplink client are the endpoints of a bridge.
+struct Bridge {
+    Bridge()
+        : device_socket(emulated.network),
+          uplink_socket(emulated.network),
+          device(device_socket, "/device"),
+          uplink(uplink_socket, "/uplink"),
+          device_connection(emulated.connect(device)),
+          upstream(emulated.connect(uplink)) {}
+
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client device_socket;
+    PicoWebsocket::Emulator::Client uplink_socket;
+    PongCounter device;
+    PicoWebsocket::Client uplink;
+    PicoWebsocket::ServerClient & device_connection;
+    PicoWebsocket::ServerClient & upstream;
+};
+
+std::vector<uint8_t> pattern(size_t size, uint8_t seed = 0) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7 + seed;
+    }
+    return data;
+}
+
+// Send fragmented and single frame messages of odd sizes from sender, relay
+// them from source to destination and check what arrives at receiver.
+void check_relay(Bridge & bridge, PicoWebsocket::ClientBase & sender,
+                 PicoWebsocket::ClientBase & source,
+                 PicoWebsocket::ClientBase & destination,
+                 PicoWebsocket::ClientBase & receiver) {
+    IncomingFrames frames;
+    receiver.tap = &frames;
+
+    const std::vector<uint8_t> data = pattern(5003, 3);
+    sender.write(data.data(), 1001, false);
+    sender.write(data.data() + 1001, 0, false);
+    sender.write(data.data() + 1001, 4002, true);
+    sender.write((const uint8_t *)"hello", 5, true, false);
+
+    PicoWebsocket::Relay relay(source, destination);
+    std::vector<uint8_t> received;
+    bridge.emulated.run([&] {
+        relay.forward();
+        uint8_t buffer[100];
+        int size;
+        while ((size = receiver.read(buffer, sizeof(buffer))) > 0) {
+            received.insert(received.end(), buffer, buffer + size);
+        }
+    });
+
+    std::vector<uint8_t> expected = data;
+    expected.insert(expected.end(), {'h', 'e', 'l', 'l', 'o'});
+    TEST_ASSERT_EQUAL(expected.size(), received.size());
+    TEST_ASSERT_TRUE(received == expected);
+
+    // frames arrive unchanged
+    TEST_ASSERT_EQUAL(4, relay.frames);
+    TEST_ASSERT_EQUAL(expected.size(), relay.bytes);
+    TEST_ASSERT_EQUAL(4, frames.heads.size());
+    const IncomingFrames::Head expected_heads[] = {
+        {0x2, false, 1001}, {0x0, false, 0}, {0x0, true, 4002}, {0x1, true, 5}};
+    for (int i = 0; i < 4; ++i) {
+        const IncomingFrames::Head & head = frames.heads[i];
+        TEST_ASSERT_EQUAL_HEX8(expected_heads[i].opcode, head.opcode);
+        TEST_ASSERT_EQUAL(expected_heads[i].fin, head.fin);
+        TEST_ASSERT_EQUAL(expected_heads[i].length, head.length);
+    }
+
+    receiver.tap = nullptr;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_server_to_client() {
+    // unmasks with the device's key and masks with the uplink's in one pass
+    Bridge bridge;
+    check_relay(bridge, bridge.device, bridge.device_connection, bridge.uplink,
+                bridge.upstream);
+}
+
+void test_client_to_server() {
+    // nothing to unmask, nothing to mask
+    Bridge bridge;
+    check_relay(bridge, bridge.upstream, bridge.uplink,
+                bridge.device_connection, bridge.device);
+}
+
+void test_server_to_server() {
+    Bridge bridge;
+    check_relay(bridge, bridge.device, bridge.device_connection,
+                bridge.upstream, bridge.uplink);
+}
+
+void test_client_to_client() {
+    Bridge bridge;
+    check_relay(bridge, bridge.upstream, bridge.uplink, bridge.device,
+                bridge.device_connection);
+}
+
+void test_tapped_relay() {
+    // taps see unmasked data, so masks are applied in two steps
+    Bridge bridge;
+    NullTap source_tap, destination_tap;
+    bridge.device_connection.tap = &source_tap;
+    bridge.uplink.tap = &destination_tap;
+    check_relay(bridge, bridge.device, bridge.device_connection, bridge.uplink,
+                bridge.upstream);
+    TEST_ASSERT_EQUAL(5008, source_tap.bytes);
+    TEST_ASSERT_EQUAL(5008, destination_tap.bytes);
+}
+
+void test_control_frames_not_forwarded() {
+    Bridge bridge;
+    IncomingFrames frames;
+    bridge.upstream.tap = &frames;
+
+    // the ping is answered by the bridge, the data goes through
+    bridge.device.ping("p", 1);
+    bridge.device.write((const uint8_t *)"data", 4);
+    PicoWebsocket::Relay relay(bridge.device_connection, bridge.uplink);
+    bridge.emulated.run([&] {
+        relay.forward();
+        bridge.upstream.available();
+        bridge.device.available();
+    });
+
+    TEST_ASSERT_EQUAL(1, bridge.device.pongs);
+    TEST_ASSERT_EQUAL(1, relay.frames);
+    TEST_ASSERT_EQUAL(1, frames.heads.size());
+    TEST_ASSERT_EQUAL(4, bridge.upstream.available());
+    bridge.upstream.tap = nullptr;
+}
+
+void test_source_lost_mid_frame() {
+    Bridge bridge;
+
+    // a masked frame announcing 1000 bytes of payload, only 10 follow
+    const uint8_t head[] = {0x82, 0xfe, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x00};
+    bridge.device_socket.write(head, sizeof(head));
+    const uint8_t payload[10] = {};
+    bridge.device_socket.write(payload, sizeof(payload));
+
+    // the destination can't get a complete frame, so it's dropped
+    PicoWebsocket::Relay relay(bridge.device_connection, bridge.uplink);
+    bridge.emulated.run([&] {
+        relay.forward();
+        bridge.upstream.available();
+    });
+    TEST_ASSERT_EQUAL(0, relay.frames);
+    TEST_ASSERT_FALSE(bridge.uplink.connected());
+    TEST_ASSERT_FALSE(bridge.upstream.connected());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_server_to_client);
+    RUN_TEST(test_client_to_server);
+    RUN_TEST(test_server_to_server);
+    RUN_TEST(test_client_to_client);
+    RUN_TEST(test_tapped_relay);
+    RUN_TEST(test_control_frames_not_forwarded);
+    RUN_TEST(test_source_lost_mid_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,123 @@
+#include <PicoWebsocketRouter.h>
+#include <emulated.h>
+#include <unity.h>
+
+using PicoWebsocket::ServerInterface;
+
+void setUp() {}
+void tearDown() {}
+
+void test_router_exact_routes() {
+    PicoWebsocket::Router router;
+    ServerInterface telemetry, tele, control;
+    router.add("/telemetry", telemetry);
+    router.add("/tele", tele);
+    router.add("/control", control);
+
+    TEST_ASSERT_EQUAL_PTR(&telemetry, router.match("/telemetry"));
+    TEST_ASSERT_EQUAL_PTR(&tele, router.match("/tele"));
+    TEST_ASSERT_EQUAL_PTR(&control, router.match("/control"));
+
+    // partial and longer paths don't match exact routes
+    TEST_ASSERT_NULL(router.match("/tel"));
+    TEST_ASSERT_NULL(router.match("/telemetryx"));
+    TEST_ASSERT_NULL(router.match("/"));
+    TEST_ASSERT_NULL(router.match(""));
+}
+
+void test_router_ignores_query_string() {
+    PicoWebsocket::Router router;
+    ServerInterface control;
+    router.add("/control", control);
+
+    TEST_ASSERT_EQUAL_PTR(&control, router.match("/control?id=1"));
+    TEST_ASSERT_NULL(router.match("/contr?ol"));
+}
+
+void test_router_prefix_routes() {
+    PicoWebsocket::Router router;
+    ServerInterface logs, logs_x, everything;
+    router.add("/logs/*", logs);
+    router.add("/logs/x", logs_x);
+
+    TEST_ASSERT_EQUAL_PTR(&logs, router.match("/logs/"));
+    TEST_ASSERT_EQUAL_PTR(&logs, router.match("/logs/abc?q=1"));
+    TEST_ASSERT_EQUAL_PTR(&logs, router.match("/logs/xy"));
+    TEST_ASSERT_NULL(router.match("/logs"));
+
+    // exact routes take precedence over prefix routes
+    TEST_ASSERT_EQUAL_PTR(&logs_x, router.match("/logs/x"));
+
+    // longer prefixes take precedence over shorter ones
+    router.add("*", everything);
+    TEST_ASSERT_EQUAL_PTR(&everything, router.match("/"));
+    TEST_ASSERT_EQUAL_PTR(&everything, router.match("/log"));
+    TEST_ASSERT_EQUAL_PTR(&logs, router.match("/logs/abc"));
+}
+
+void test_router_replaces_route() {
+    PicoWebsocket::Router router;
+    ServerInterface first, second;
+    router.add("/chat", first);
+    router.add("/chat", second);
+    TEST_ASSERT_EQUAL_PTR(&second, router.match("/chat"));
+}
+
+class Endpoint : public ServerInterface {
+public:
+    using ServerInterface::ServerInterface;
+
+    unsigned int messages = 0;
+
+    virtual void on_message(PicoWebsocket::ServerClient & websocket) override {
+        uint8_t buffer[16];
+        while (websocket.read(buffer, sizeof(buffer)) > 0) {
+        }
+        ++messages;
+    }
+};
+
+void test_routed_server() {
+    using RoutedServer =
+        PicoWebsocket::RoutedServer<PicoWebsocket::Emulator::Server>;
+    BasicEmulated<RoutedServer> emulated;
+    Endpoint chat("chat"), logs;
+    emulated.server.add("/chat", chat);
+    emulated.server.add("/logs/*", logs);
+
+    PicoWebsocket::Emulator::Client sockets[3] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client chat_client(sockets[0], "/chat", "chat");
+    PicoWebsocket::Client logs_client(sockets[1], "/logs/1");
+    PicoWebsocket::Client unknown_client(sockets[2], "/nope");
+
+    auto & chat_connection = emulated.connect(chat_client);
+    auto & logs_connection = emulated.connect(logs_client);
+    TEST_ASSERT_EQUAL_PTR(&chat, &chat_connection.get_endpoint());
+    TEST_ASSERT_EQUAL_PTR(&logs, &logs_connection.get_endpoint());
+
+    // rejected with 404
+    TEST_ASSERT_NULL(emulated.open(unknown_client));
+
+    // messages are dispatched to the endpoint of the route
+    chat_client.write((const uint8_t *)"hi", 2);
+    emulated.run([&] {
+        chat_connection.dispatch();
+        logs_connection.dispatch();
+    });
+    TEST_ASSERT_EQUAL(1, chat.messages);
+    TEST_ASSERT_EQUAL(0, logs.messages);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_router_exact_routes);
+    RUN_TEST(test_router_ignores_query_string);
+    RUN_TEST(test_router_prefix_routes);
+    RUN_TEST(test_router_replaces_route);
+    RUN_TEST(test_routed_server);
+    return UNITY_END();
+}
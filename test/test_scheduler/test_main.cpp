@@ -0,0 +1,134 @@
+#include <PicoWebsocketScheduler.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <functional>
+#include <vector>
+
+const size_t quantum = 300;
+
+// Two clients on the emulated network, one floods the server with data,
+// the other one only sends a little.
+struct Clients {
+    Clients()
+        : flooding_socket(emulated.network),
+          quiet_socket(emulated.network),
+          flooding(flooding_socket, "/"),
+          quiet(quiet_socket, "/"),
+          flooding_connection(emulated.connect(flooding)),
+          quiet_connection(emulated.connect(quiet)) {}
+
+    // Deliver everything in flight.
+    void deliver() {
+        while (emulated.network.step()) {
+        }
+    }
+
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client flooding_socket;
+    PicoWebsocket::Emulator::Client quiet_socket;
+    PicoWebsocket::Client flooding;
+    PicoWebsocket::Client quiet;
+    Emulated::Server::Client & flooding_connection;
+    Emulated::Server::Client & quiet_connection;
+};
+
+// Handler reading up to 100 bytes at a time and counting what it read.
+struct Reader {
+    Reader(Clients & clients) : clients(clients), flooding(0), quiet(0) {}
+
+    size_t operator()(PicoWebsocket::ServerClient & connection,
+                      size_t budget) {
+        uint8_t buffer[100];
+        const int size = connection.read(
+            buffer, budget < sizeof(buffer) ? budget : sizeof(buffer));
+        if (size <= 0) {
+            return 0;
+        }
+        (&connection == &clients.quiet_connection ? quiet : flooding) += size;
+        return size;
+    }
+
+    Clients & clients;
+    size_t flooding;
+    size_t quiet;
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_flooding_client_gets_one_quantum_per_round() {
+    Clients clients;
+    const std::vector<uint8_t> flood(20000, 'x');
+    clients.flooding.write(flood.data(), flood.size());
+    clients.deliver();
+
+    PicoWebsocket::FairScheduler scheduler(quantum);
+    Reader reader(clients);
+    for (int round = 1; round <= 10; ++round) {
+        clients.quiet.write((const uint8_t *)"ping", 4);
+        clients.deliver();
+
+        scheduler.run(clients.emulated.connections, std::ref(reader));
+
+        // the quiet client is served in full in every round
+        TEST_ASSERT_EQUAL(4 * round, reader.quiet);
+        TEST_ASSERT_EQUAL(quantum * round, reader.flooding);
+    }
+
+    auto & stats = clients.flooding_connection.schedule;
+    TEST_ASSERT_EQUAL(10, stats.deferred_rounds);
+    TEST_ASSERT_EQUAL(0, clients.quiet_connection.schedule.deferred_rounds);
+    TEST_ASSERT_EQUAL(10, scheduler.rounds);
+}
+
+void test_stalled_client_cannot_save_up() {
+    Clients clients;
+    const std::vector<uint8_t> flood(20000, 'x');
+    clients.flooding.write(flood.data(), flood.size());
+    clients.deliver();
+
+    PicoWebsocket::FairScheduler scheduler(quantum);
+    Reader reader(clients);
+
+    // the handler can't make progress on the flooding connection for a while
+    auto stalled = [&](PicoWebsocket::ServerClient & connection,
+                       size_t budget) -> size_t {
+        if (&connection == &clients.flooding_connection) {
+            return 0;
+        }
+        return reader(connection, budget);
+    };
+    for (int round = 0; round < 100; ++round) {
+        scheduler.run(clients.emulated.connections, stalled);
+    }
+    TEST_ASSERT_EQUAL(0, reader.flooding);
+
+    // once it's unblocked, the burst is limited
+    scheduler.run(clients.emulated.connections, std::ref(reader));
+    TEST_ASSERT_EQUAL(2 * quantum, reader.flooding);
+    scheduler.run(clients.emulated.connections, std::ref(reader));
+    TEST_ASSERT_EQUAL(3 * quantum, reader.flooding);
+}
+
+void test_budget_dropped_when_idle() {
+    Clients clients;
+    PicoWebsocket::FairScheduler scheduler(quantum);
+    Reader reader(clients);
+
+    clients.quiet.write((const uint8_t *)"ping", 4);
+    clients.deliver();
+    scheduler.run(clients.emulated.connections, std::ref(reader));
+
+    TEST_ASSERT_EQUAL(4, reader.quiet);
+    TEST_ASSERT_EQUAL(0, clients.quiet_connection.schedule.deficit);
+    TEST_ASSERT_EQUAL(4, clients.quiet_connection.schedule.bytes_served);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_flooding_client_gets_one_quantum_per_round);
+    RUN_TEST(test_stalled_client_cannot_save_up);
+    RUN_TEST(test_budget_dropped_when_idle);
+    return UNITY_END();
+}
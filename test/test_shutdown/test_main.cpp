@@ -0,0 +1,134 @@
+#include <emulated.h>
+#include <unity.h>
+
+void setUp() {}
+void tearDown() {}
+
+void test_shutdown_without_connections() {
+    Emulated emulated;
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_EQUAL(0, emulated.server.shutdown(emulated.connections));
+    TEST_ASSERT_EQUAL(start_us, emulated.network.now_us());
+}
+
+void test_shutdown_collects_close_replies() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    emulated.connect(websocket);
+
+    // The peer is closing as well, its close frame answers the server's.
+    // Only the server is polled during the shutdown, so this is the only way
+    // to get a reply in a single threaded test.
+    websocket.begin_close(1000);
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_EQUAL(1, emulated.server.shutdown(emulated.connections));
+    TEST_ASSERT_FALSE(emulated.connections.front().connected());
+
+    // done after a one way trip, long before the timeout
+    TEST_ASSERT_TRUE(emulated.network.now_us() - start_us < 100000);
+
+    emulated.run([&] { websocket.poll_close(); });
+    TEST_ASSERT_TRUE(websocket.poll_close());
+}
+
+void test_shutdown_gives_up_after_timeout() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client sockets[2] = {
+        PicoWebsocket::Emulator::Client(emulated.network),
+        PicoWebsocket::Emulator::Client(emulated.network),
+    };
+    PicoWebsocket::Client a(sockets[0], "/"), b(sockets[1], "/");
+    emulated.connect(a);
+    emulated.connect(b);
+
+    // the peers are never polled, so they never reply
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_EQUAL(0, emulated.server.shutdown(emulated.connections));
+
+    // waited in virtual time, through the wait strategy, for a single timeout
+    const uint64_t elapsed_ms = (emulated.network.now_us() - start_us) / 1000;
+    TEST_ASSERT_TRUE(elapsed_ms >= emulated.server.socket_timeout_ms);
+    TEST_ASSERT_TRUE(elapsed_ms < 2 * emulated.server.socket_timeout_ms);
+
+    for (auto & connection : emulated.connections) {
+        TEST_ASSERT_FALSE(connection.connected());
+    }
+}
+
+void test_poll_close_does_not_block_on_partial_frame() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    // the start of a masked binary frame with a 16 bit length
+    const uint8_t head[] = {0x82, 0xfe};
+    socket.write(head, sizeof(head));
+    while (emulated.network.step()) {
+    }
+
+    connection.begin_close(1001);
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_FALSE(connection.poll_close());
+    TEST_ASSERT_EQUAL(start_us, emulated.network.now_us());
+
+    // the rest of the frame arrives, followed by the peer's close reply
+    const uint8_t rest[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x42};
+    socket.write(rest, sizeof(rest));
+    emulated.run([&] {
+        websocket.poll_close();
+        connection.poll_close();
+    });
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    TEST_ASSERT_TRUE(connection.poll_close());
+}
+
+void test_client_close_after_short_data_frame() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    // Only the server is polled, so the client gets a short data frame and
+    // the close reply in one go, 8 bytes in total.
+    connection.write((const uint8_t *)"hi", 2);
+    websocket.begin_close(1000);
+    emulated.run([&] { connection.available(); });
+    TEST_ASSERT_FALSE(connection.connected());
+
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    TEST_ASSERT_EQUAL(start_us, emulated.network.now_us());
+}
+
+void test_close_reply_split_across_reads() {
+    Emulated emulated;
+    // deliver the close reply one byte at a time, 1 ms apart
+    emulated.network.downstream.mss = 1;
+    emulated.network.downstream.bandwidth = 1000;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.begin_close(1000);
+    unsigned int polls = 0;
+    while (!websocket.poll_close()) {
+        connection.available();
+        TEST_ASSERT_TRUE(emulated.network.step());
+        ++polls;
+    }
+    TEST_ASSERT_FALSE(connection.connected());
+    TEST_ASSERT_TRUE(polls < 20);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_shutdown_without_connections);
+    RUN_TEST(test_shutdown_collects_close_replies);
+    RUN_TEST(test_shutdown_gives_up_after_timeout);
+    RUN_TEST(test_poll_close_does_not_block_on_partial_frame);
+    RUN_TEST(test_client_close_after_short_data_frame);
+    RUN_TEST(test_close_reply_split_across_reads);
+    return UNITY_END();
+}
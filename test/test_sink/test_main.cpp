@@ -0,0 +1,189 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Collects messages and records the calls it gets.
+struct CollectingSink : public PicoWebsocket::MessageSink {
+    virtual void on_message_begin(bool bin, size_t length,
+                                  bool fragmented) override {
+        ++begins;
+        binary = bin;
+        first_length = length;
+        was_fragmented = fragmented;
+        current.clear();
+    }
+
+    virtual bool on_message_data(const void * data, size_t size) override {
+        TEST_ASSERT_TRUE(size <= PICOWEBSOCKET_SINK_CHUNK_SIZE);
+        ++chunks;
+        const uint8_t * bytes = (const uint8_t *)data;
+        current.insert(current.end(), bytes, bytes + size);
+        return current.size() <= accept_size;
+    }
+
+    virtual void on_message_end() override { messages.push_back(current); }
+
+    virtual void on_message_abort() override { ++aborts; }
+
+    size_t accept_size = SIZE_MAX;
+
+    std::vector<std::vector<uint8_t>> messages;
+    std::vector<uint8_t> current;
+    unsigned int begins = 0;
+    unsigned int chunks = 0;
+    unsigned int aborts = 0;
+    bool binary = false;
+    size_t first_length = 0;
+    bool was_fragmented = false;
+};
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    return data;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_large_message_streamed_in_chunks() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(100000);
+    websocket.write(data.data(), data.size());
+
+    CollectingSink sink;
+    size_t received = 0;
+    emulated.run([&] { received += connection.receive(sink); });
+
+    TEST_ASSERT_EQUAL(data.size(), received);
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_TRUE(sink.binary);
+    TEST_ASSERT_FALSE(sink.was_fragmented);
+    TEST_ASSERT_EQUAL(data.size(), sink.first_length);
+    TEST_ASSERT_TRUE(sink.chunks >=
+                     data.size() / PICOWEBSOCKET_SINK_CHUNK_SIZE);
+    TEST_ASSERT_EQUAL(1, sink.messages.size());
+    TEST_ASSERT_TRUE(sink.messages[0] == data);
+}
+
+void test_fragmented_message_with_ping() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(1000);
+    websocket.write(data.data(), 300, false);
+    websocket.ping("p", 1);
+    websocket.write(data.data() + 300, 0, false);
+    websocket.write(data.data() + 300, 700, true);
+
+    CollectingSink sink;
+    emulated.run([&] {
+        connection.receive(sink);
+        websocket.available();
+    });
+
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_TRUE(sink.was_fragmented);
+    TEST_ASSERT_EQUAL(300, sink.first_length);
+    TEST_ASSERT_EQUAL(1, sink.messages.size());
+    TEST_ASSERT_TRUE(sink.messages[0] == data);
+}
+
+void test_consecutive_messages() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(500);
+    websocket.write(data.data(), data.size());
+    websocket.write(data.data(), 0);
+    websocket.write(data.data(), 10);
+
+    CollectingSink sink;
+    emulated.run([&] { connection.receive(sink); });
+
+    TEST_ASSERT_EQUAL(3, sink.messages.size());
+    TEST_ASSERT_TRUE(sink.messages[0] == data);
+    TEST_ASSERT_TRUE(sink.messages[1].empty());
+    TEST_ASSERT_TRUE(sink.messages[2] ==
+                     std::vector<uint8_t>(data.begin(), data.begin() + 10));
+    TEST_ASSERT_EQUAL(0, sink.aborts);
+}
+
+void test_rejected_message_closes_connection() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(2000);
+    websocket.write(data.data(), data.size());
+    websocket.write(data.data(), 10);
+
+    CollectingSink sink;
+    sink.accept_size = 1000;
+    emulated.run([&] {
+        connection.receive(sink);
+        websocket.available();
+    });
+
+    // nothing is passed on after the rejection
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_EQUAL(1, sink.aborts);
+    TEST_ASSERT_TRUE(sink.messages.empty());
+    TEST_ASSERT_FALSE(connection.connected());
+    TEST_ASSERT_FALSE(websocket.connected());
+}
+
+void test_abort_on_disconnect() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(100);
+    websocket.write(data.data(), data.size(), false);
+
+    CollectingSink sink;
+    emulated.run([&] { connection.receive(sink); });
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_EQUAL(100, sink.current.size());
+
+    websocket.abort();
+    emulated.run([&] { connection.receive(sink); });
+    TEST_ASSERT_EQUAL(1, sink.aborts);
+    TEST_ASSERT_TRUE(sink.messages.empty());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_large_message_streamed_in_chunks);
+    RUN_TEST(test_fragmented_message_with_ping);
+    RUN_TEST(test_consecutive_messages);
+    RUN_TEST(test_rejected_message_closes_connection);
+    RUN_TEST(test_abort_on_disconnect);
+    return UNITY_END();
+}
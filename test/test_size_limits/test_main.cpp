@@ -0,0 +1,123 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+// Records the status code of the close frame received.
+class CloseCodeTap : public PicoWebsocket::FrameTap {
+public:
+    CloseCodeTap() : code(0), in_close_frame(false) {}
+
+    virtual void on_frame_head(bool outgoing, uint8_t opcode, bool fin,
+                               size_t payload_length) override {
+        in_close_frame = !outgoing && (opcode == 0x8);
+    }
+
+    virtual void on_frame_payload(bool outgoing, const void * data,
+                                  size_t size) override {
+        if (in_close_frame && (size >= 2)) {
+            const uint8_t * payload = (const uint8_t *)data;
+            code = payload[0] << 8 | payload[1];
+            in_close_frame = false;
+        }
+    }
+
+    uint16_t code;
+    bool in_close_frame;
+};
+
+struct Result {
+    size_t received;
+    bool connected;
+    uint16_t close_code;
+};
+
+// Send a message of size bytes in frames of up to frame_size bytes (0 means a
+// single frame) to a server with the given limits.
+Result send_message(size_t max_frame_size, size_t max_message_size,
+                    size_t frame_size, size_t size) {
+    Emulated emulated;
+    emulated.server.max_incoming_frame_size = max_frame_size;
+    emulated.server.max_incoming_message_size = max_message_size;
+
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    CloseCodeTap tap;
+    websocket.tap = &tap;
+    websocket.max_frame_size = frame_size;
+
+    const std::vector<uint8_t> message(size, 'x');
+    websocket.write(message.data(), message.size());
+
+    Result result = {0, false, 0};
+    emulated.run([&] {
+        uint8_t buffer[256];
+        int bytes_read;
+        while ((bytes_read = connection.read(buffer, sizeof(buffer))) > 0) {
+            result.received += bytes_read;
+        }
+        websocket.available();
+    });
+    result.connected = connection.connected();
+    result.close_code = tap.code;
+    return result;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_no_limits() {
+    const Result result = send_message(0, 0, 0, 20000);
+    TEST_ASSERT_EQUAL(20000, result.received);
+    TEST_ASSERT_TRUE(result.connected);
+    TEST_ASSERT_EQUAL(0, result.close_code);
+}
+
+void test_frame_too_large() {
+    const Result result = send_message(1000, 0, 0, 2000);
+    TEST_ASSERT_EQUAL(0, result.received);
+    TEST_ASSERT_FALSE(result.connected);
+    TEST_ASSERT_EQUAL(1009, result.close_code);
+}
+
+void test_frame_at_limit() {
+    const Result result = send_message(1000, 0, 0, 1000);
+    TEST_ASSERT_EQUAL(1000, result.received);
+    TEST_ASSERT_TRUE(result.connected);
+}
+
+void test_fragments_within_frame_limit() {
+    // the frame limit doesn't restrict the message size
+    const Result result = send_message(1000, 0, 500, 2000);
+    TEST_ASSERT_EQUAL(2000, result.received);
+    TEST_ASSERT_TRUE(result.connected);
+    TEST_ASSERT_EQUAL(0, result.close_code);
+}
+
+void test_message_too_large() {
+    // fragments are fine on their own, but add up to too much
+    const Result result = send_message(0, 1000, 500, 2000);
+    TEST_ASSERT_TRUE(result.received <= 1000);
+    TEST_ASSERT_FALSE(result.connected);
+    TEST_ASSERT_EQUAL(1009, result.close_code);
+}
+
+void test_message_at_limit() {
+    const Result result = send_message(0, 1000, 500, 1000);
+    TEST_ASSERT_EQUAL(1000, result.received);
+    TEST_ASSERT_TRUE(result.connected);
+    TEST_ASSERT_EQUAL(0, result.close_code);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_limits);
+    RUN_TEST(test_frame_too_large);
+    RUN_TEST(test_frame_at_limit);
+    RUN_TEST(test_fragments_within_frame_limit);
+    RUN_TEST(test_message_too_large);
+    RUN_TEST(test_message_at_limit);
+    return UNITY_END();
+}
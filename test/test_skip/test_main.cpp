@@ -0,0 +1,139 @@
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+// Wait for data, then read what's there.
+int read_some(Emulated & emulated, PicoWebsocket::ServerClient & connection,
+              uint8_t * buffer, size_t size) {
+    int read_size;
+    while (!(read_size = connection.read(buffer, size)) &&
+           emulated.network.step()) {
+    }
+    return read_size;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_skip_frame_waits_for_payload() {
+    Emulated emulated;
+    // the frame takes a while to arrive
+    emulated.network.upstream.bandwidth = 100000;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data(50000, 'a');
+    websocket.write(data.data(), data.size());
+    websocket.write((const uint8_t *)"next", 4);
+
+    uint8_t buffer[16];
+    TEST_ASSERT_TRUE(read_some(emulated, connection, buffer, 10) > 0);
+    TEST_ASSERT_TRUE(emulated.network.bytes_delivered < data.size());
+
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_TRUE(connection.skip_frame());
+    TEST_ASSERT_TRUE(emulated.network.now_us() > start_us);
+
+    TEST_ASSERT_EQUAL(4, read_some(emulated, connection, buffer, 16));
+    TEST_ASSERT_EQUAL_MEMORY("next", buffer, 4);
+}
+
+void test_skip_frame_keeps_rest_of_message() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.write((const uint8_t *)"first", 5, false);
+    websocket.write((const uint8_t *)"second", 6, true);
+
+    uint8_t buffer[16];
+    TEST_ASSERT_EQUAL(1, read_some(emulated, connection, buffer, 1));
+    TEST_ASSERT_TRUE(connection.skip_frame());
+    TEST_ASSERT_EQUAL(6, read_some(emulated, connection, buffer, 16));
+    TEST_ASSERT_EQUAL_MEMORY("second", buffer, 6);
+}
+
+void test_skip_message_handles_control_frames() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data(3000, 'a');
+    websocket.write(data.data(), data.size(), false);
+    websocket.ping("p", 1);
+    websocket.write(data.data(), 0, false);
+    websocket.write(data.data(), data.size(), true);
+    websocket.write((const uint8_t *)"hello", 5);
+
+    uint8_t buffer[16];
+    TEST_ASSERT_EQUAL(10, read_some(emulated, connection, buffer, 10));
+    TEST_ASSERT_TRUE(connection.skip_message());
+    TEST_ASSERT_EQUAL(5, read_some(emulated, connection, buffer, 16));
+    TEST_ASSERT_EQUAL_MEMORY("hello", buffer, 5);
+
+    emulated.run([&] { websocket.available(); });
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+}
+
+void test_skip_without_data() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_TRUE(connection.skip_frame());
+    TEST_ASSERT_TRUE(connection.skip_message());
+    TEST_ASSERT_EQUAL(start_us, emulated.network.now_us());
+}
+
+void test_skip_frame_times_out() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    // a masked frame announcing 1000 bytes of payload, only 10 follow
+    const uint8_t head[] = {0x82, 0xfe, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x00};
+    socket.write(head, sizeof(head));
+    const uint8_t payload[10] = {};
+    socket.write(payload, sizeof(payload));
+
+    uint8_t buffer[16];
+    TEST_ASSERT_EQUAL(10, read_some(emulated, connection, buffer, 16));
+
+    const uint64_t start_us = emulated.network.now_us();
+    TEST_ASSERT_FALSE(connection.skip_frame());
+    TEST_ASSERT_FALSE(connection.connected());
+
+    // waited in virtual time for a single timeout
+    const uint64_t elapsed_ms = (emulated.network.now_us() - start_us) / 1000;
+    TEST_ASSERT_TRUE(elapsed_ms >= connection.socket_timeout_ms);
+    TEST_ASSERT_TRUE(elapsed_ms < 2 * connection.socket_timeout_ms);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_skip_frame_waits_for_payload);
+    RUN_TEST(test_skip_frame_keeps_rest_of_message);
+    RUN_TEST(test_skip_message_handles_control_frames);
+    RUN_TEST(test_skip_without_data);
+    RUN_TEST(test_skip_frame_times_out);
+    return UNITY_END();
+}
@@ -0,0 +1,161 @@
+#include <PicoWebsocketSplit.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+class PongCounter : public PicoWebsocket::Client {
+public:
+    using PicoWebsocket::Client::Client;
+
+    unsigned int pongs = 0;
+
+protected:
+    virtual void on_pong(const void * data, const size_t size) override {
+        ++pongs;
+    }
+};
+
+std::vector<uint8_t> pattern(size_t size, uint8_t seed = 0) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7 + seed;
+    }
+    return data;
+}
+
+// Read what's available from a websocket into received.
+template <typename Reader>
+void read_into(Reader & reader, std::vector<uint8_t> & received) {
+    uint8_t buffer[100];
+    int size;
+    while ((size = reader.read(buffer, sizeof(buffer))) > 0) {
+        received.insert(received.end(), buffer, buffer + size);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_interleaved_reads_and_writes() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    PicoWebsocket::ReadHalf reader(connection);
+    PicoWebsocket::WriteHalf writer(connection);
+
+    // both directions carry fragmented messages at the same time, with a
+    // ping in the middle
+    const std::vector<uint8_t> upstream = pattern(30000, 1);
+    const std::vector<uint8_t> downstream = pattern(30000, 2);
+    websocket.max_frame_size = 1000;
+    connection.max_frame_size = 700;
+    websocket.write(upstream.data(), 15500, false);
+    websocket.ping("p", 1);
+    websocket.write(upstream.data() + 15500, upstream.size() - 15500, true);
+
+    std::vector<uint8_t> server_received, client_received;
+    size_t written = 0;
+    emulated.run([&] {
+        read_into(reader, server_received);
+        if (written < downstream.size()) {
+            const size_t size = std::min<size_t>(1234, downstream.size() -
+                                                           written);
+            const bool fin = (written + size == downstream.size());
+            written += writer.write(downstream.data() + written, size, fin);
+        }
+        read_into(websocket, client_received);
+    });
+
+    TEST_ASSERT_TRUE(server_received == upstream);
+    TEST_ASSERT_TRUE(client_received == downstream);
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+}
+
+void test_ping_reply_sent_by_writer() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PongCounter websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    PicoWebsocket::ReadHalf reader(connection);
+    PicoWebsocket::WriteHalf writer(connection);
+
+    // the reader handles the ping, but never writes
+    websocket.ping("p", 1);
+    emulated.run([&] {
+        reader.available();
+        websocket.available();
+    });
+    TEST_ASSERT_EQUAL(0, websocket.pongs);
+
+    // the pong goes out ahead of the writer's next frame
+    writer.write((const uint8_t *)"data", 4);
+    std::vector<uint8_t> received;
+    emulated.run([&] { read_into(websocket, received); });
+    TEST_ASSERT_EQUAL(1, websocket.pongs);
+    TEST_ASSERT_EQUAL(4, received.size());
+
+    // or when the writer is flushed
+    websocket.ping("q", 1);
+    emulated.run([&] { reader.available(); });
+    writer.flush();
+    emulated.run([&] { websocket.available(); });
+    TEST_ASSERT_EQUAL(2, websocket.pongs);
+}
+
+void test_peer_close_confirmed_by_writer() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    PicoWebsocket::ReadHalf reader(connection);
+    PicoWebsocket::WriteHalf writer(connection);
+
+    websocket.begin_close(1000);
+    emulated.run([&] {
+        reader.available();
+        websocket.poll_close();
+    });
+    TEST_ASSERT_FALSE(websocket.poll_close());
+
+    writer.flush();
+    emulated.run([&] { websocket.poll_close(); });
+    TEST_ASSERT_TRUE(websocket.poll_close());
+    TEST_ASSERT_FALSE(reader.connected());
+
+    // nothing goes out after the close
+    TEST_ASSERT_EQUAL(0, writer.write((const uint8_t *)"late", 4));
+}
+
+void test_writer_close_seen_by_reader() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+    PicoWebsocket::ReadHalf reader(connection);
+    PicoWebsocket::WriteHalf writer(connection);
+
+    // data already on its way is still read
+    websocket.write((const uint8_t *)"last", 4);
+    writer.close(1001);
+
+    std::vector<uint8_t> received;
+    emulated.run([&] {
+        read_into(reader, received);
+        websocket.available();
+    });
+    TEST_ASSERT_EQUAL(4, received.size());
+    TEST_ASSERT_FALSE(reader.connected());
+    TEST_ASSERT_FALSE(websocket.connected());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_interleaved_reads_and_writes);
+    RUN_TEST(test_ping_reply_sent_by_writer);
+    RUN_TEST(test_peer_close_confirmed_by_writer);
+    RUN_TEST(test_writer_close_seen_by_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,205 @@
+#include <PicoWebsocketEmulator.h>
+#include <PicoWebsocketTimer.h>
+#include <unity.h>
+
+using PicoWebsocket::Timer;
+using PicoWebsocket::TimerWheel;
+
+// The wheel counts time from its creation, run it on a virtual clock starting
+// at 0 so that the tests can use absolute times.
+PicoWebsocket::Emulator::VirtualClock virtual_clock;
+
+class CountingTimer : public Timer {
+public:
+    CountingTimer(TimerWheel & timers)
+        : timers(timers), fired(0), reschedule_ms(0), cancel_timer(nullptr) {}
+
+    void start(unsigned long delay_ms) { schedule(timers, delay_ms); }
+
+    TimerWheel & timers;
+    unsigned int fired;
+
+    // actions taken in on_timeout()
+    unsigned long reschedule_ms;
+    Timer * cancel_timer;
+
+protected:
+    virtual void on_timeout() override {
+        ++fired;
+        if (cancel_timer) {
+            cancel_timer->cancel();
+        }
+        if (reschedule_ms) {
+            start(reschedule_ms);
+            reschedule_ms = 0;
+        }
+    }
+};
+
+void setUp() {
+    virtual_clock.now_us = 0;
+    PicoWebsocket::set_clock(&virtual_clock);
+}
+
+void tearDown() { PicoWebsocket::set_clock(nullptr); }
+
+void test_fires_after_delay() {
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+
+    // rounded up to the resolution
+    timer.start(25);
+    TEST_ASSERT_TRUE(timer.scheduled());
+    TEST_ASSERT_EQUAL(1, wheel.size());
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(29));
+    TEST_ASSERT_EQUAL(0, timer.fired);
+    TEST_ASSERT_EQUAL(1, wheel.advance(30));
+    TEST_ASSERT_EQUAL(1, timer.fired);
+    TEST_ASSERT_FALSE(timer.scheduled());
+    TEST_ASSERT_EQUAL(0, wheel.size());
+
+    // fires only once
+    TEST_ASSERT_EQUAL(0, wheel.advance(100));
+}
+
+void test_zero_delay_fires_on_next_tick() {
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+    timer.start(0);
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(9));
+    TEST_ASSERT_EQUAL(1, wheel.advance(10));
+}
+
+void test_delay_longer_than_one_revolution() {
+    // the wheel spans 80 ms
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+    timer.start(200);
+
+    for (unsigned long now = 0; now < 200; now += 10) {
+        wheel.advance(now);
+    }
+    TEST_ASSERT_EQUAL(0, timer.fired);
+    wheel.advance(200);
+    TEST_ASSERT_EQUAL(1, timer.fired);
+}
+
+void test_catch_up_after_long_pause() {
+    TimerWheel wheel(10, 8);
+    CountingTimer a(wheel), b(wheel), c(wheel), d(wheel);
+    a.start(10);
+    b.start(75);
+    c.start(150);
+    d.start(1000);
+
+    TEST_ASSERT_EQUAL(3, wheel.advance(500));
+    TEST_ASSERT_EQUAL(1, a.fired);
+    TEST_ASSERT_EQUAL(1, b.fired);
+    TEST_ASSERT_EQUAL(1, c.fired);
+    TEST_ASSERT_EQUAL(0, d.fired);
+    TEST_ASSERT_EQUAL(1, wheel.advance(1000));
+    TEST_ASSERT_EQUAL(0, wheel.size());
+}
+
+void test_cancel_and_destroy() {
+    TimerWheel wheel(10, 8);
+    CountingTimer cancelled(wheel);
+    cancelled.start(20);
+    {
+        CountingTimer destroyed(wheel);
+        destroyed.start(20);
+        TEST_ASSERT_EQUAL(2, wheel.size());
+    }
+    TEST_ASSERT_EQUAL(1, wheel.size());
+
+    cancelled.cancel();
+    TEST_ASSERT_FALSE(cancelled.scheduled());
+    TEST_ASSERT_EQUAL(0, wheel.size());
+    TEST_ASSERT_EQUAL(0, wheel.advance(100));
+}
+
+void test_reschedule() {
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+    timer.start(20);
+    timer.start(50);
+    TEST_ASSERT_EQUAL(1, wheel.size());
+
+    wheel.advance(40);
+    TEST_ASSERT_EQUAL(0, timer.fired);
+    wheel.advance(50);
+    TEST_ASSERT_EQUAL(1, timer.fired);
+}
+
+void test_reschedule_from_callback() {
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+    timer.reschedule_ms = 30;
+    timer.start(10);
+
+    wheel.advance(10);
+    TEST_ASSERT_EQUAL(1, timer.fired);
+    TEST_ASSERT_TRUE(timer.scheduled());
+    wheel.advance(39);
+    TEST_ASSERT_EQUAL(1, timer.fired);
+    wheel.advance(40);
+    TEST_ASSERT_EQUAL(2, timer.fired);
+}
+
+void test_cancel_from_callback() {
+    // two timers expiring in the same tick, whichever fires first cancels the
+    // other one
+    TimerWheel wheel(10, 8);
+    CountingTimer a(wheel), b(wheel);
+    a.cancel_timer = &b;
+    b.cancel_timer = &a;
+    a.start(20);
+    b.start(20);
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(20));
+    TEST_ASSERT_EQUAL(1, a.fired + b.fired);
+    TEST_ASSERT_EQUAL(0, wheel.size());
+}
+
+void test_copy_deadline() {
+    TimerWheel wheel(10, 8);
+    CountingTimer original(wheel), copy(wheel);
+    original.start(30);
+    wheel.advance(10);
+    copy.copy_deadline(original);
+    TEST_ASSERT_EQUAL(2, wheel.size());
+
+    wheel.advance(29);
+    TEST_ASSERT_EQUAL(0, copy.fired);
+    wheel.advance(30);
+    TEST_ASSERT_EQUAL(1, original.fired);
+    TEST_ASSERT_EQUAL(1, copy.fired);
+}
+
+void test_advance_uses_clock() {
+    TimerWheel wheel(10, 8);
+    CountingTimer timer(wheel);
+    timer.start(20);
+
+    virtual_clock.now_us = 19000;
+    TEST_ASSERT_EQUAL(0, wheel.advance());
+    virtual_clock.now_us = 20000;
+    TEST_ASSERT_EQUAL(1, wheel.advance());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fires_after_delay);
+    RUN_TEST(test_zero_delay_fires_on_next_tick);
+    RUN_TEST(test_delay_longer_than_one_revolution);
+    RUN_TEST(test_catch_up_after_long_pause);
+    RUN_TEST(test_cancel_and_destroy);
+    RUN_TEST(test_reschedule);
+    RUN_TEST(test_reschedule_from_callback);
+    RUN_TEST(test_cancel_from_callback);
+    RUN_TEST(test_copy_deadline);
+    RUN_TEST(test_advance_uses_clock);
+    return UNITY_END();
+}
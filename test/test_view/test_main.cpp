@@ -0,0 +1,159 @@
+#include <PicoWebsocketMemory.h>
+#include <emulated.h>
+#include <unity.h>
+
+#include <vector>
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    return data;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_view_in_place() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(1000);
+    websocket.write(data.data(), data.size());
+    emulated.run([] {});
+
+    // the view is limited by the buffer and stays put until consumed
+    size_t size;
+    const uint8_t * view = connection.view(size);
+    TEST_ASSERT_NOT_NULL(view);
+    TEST_ASSERT_EQUAL(PICOWEBSOCKET_VIEW_BUFFER_SIZE, size);
+    TEST_ASSERT_EQUAL_MEMORY(data.data(), view, size);
+    TEST_ASSERT_EQUAL_PTR(view, connection.view(size));
+
+    connection.consume(10);
+    view = connection.view(size);
+    TEST_ASSERT_EQUAL(PICOWEBSOCKET_VIEW_BUFFER_SIZE - 10, size);
+    TEST_ASSERT_EQUAL_MEMORY(data.data() + 10, view, size);
+
+    std::vector<uint8_t> received(data.begin(), data.begin() + 10);
+    while ((view = connection.view(size))) {
+        received.insert(received.end(), view, view + size);
+        connection.consume(size);
+    }
+    TEST_ASSERT_TRUE(received == data);
+    TEST_ASSERT_EQUAL(0, size);
+}
+
+void test_view_mixed_with_read() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    const std::vector<uint8_t> data = pattern(10000);
+    websocket.write(data.data(), data.size());
+    websocket.write(data.data(), 5);
+
+    std::vector<uint8_t> expected = data;
+    expected.insert(expected.end(), data.begin(), data.begin() + 5);
+
+    // read(), peek() and available() see the data buffered by view()
+    std::vector<uint8_t> received;
+    unsigned int step = 0;
+    emulated.run([&] {
+        while (true) {
+            size_t size;
+            const uint8_t * view = connection.view(size);
+            if (!view) {
+                break;
+            }
+            ++step;
+            TEST_ASSERT_EQUAL(view[0], connection.peek());
+            TEST_ASSERT_TRUE(connection.available() >= (int)size);
+            if (step % 3 == 0) {
+                uint8_t buffer[3];
+                const int read_size = connection.read(buffer, 3);
+                received.insert(received.end(), buffer, buffer + read_size);
+                continue;
+            }
+            const size_t take = (step % 2) && (size > 7) ? 7 : size;
+            received.insert(received.end(), view, view + take);
+            connection.consume(take);
+        }
+    });
+
+    TEST_ASSERT_EQUAL(expected.size(), received.size());
+    TEST_ASSERT_TRUE(received == expected);
+}
+
+void test_view_never_spans_frames() {
+    Emulated emulated;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.write((const uint8_t *)"abc", 3);
+    websocket.write((const uint8_t *)"defg", 4);
+    emulated.run([] {});
+
+    size_t size;
+    const uint8_t * view = connection.view(size);
+    TEST_ASSERT_EQUAL(3, size);
+    TEST_ASSERT_EQUAL_MEMORY("abc", view, 3);
+    connection.consume(3);
+
+    view = connection.view(size);
+    TEST_ASSERT_EQUAL(4, size);
+    TEST_ASSERT_EQUAL_MEMORY("defg", view, 4);
+    connection.consume(4);
+
+    TEST_ASSERT_NULL(connection.view(size));
+    TEST_ASSERT_EQUAL(0, size);
+}
+
+void test_view_buffer_charged_to_budget() {
+    Emulated emulated;
+    PicoWebsocket::MemoryBudget budget(4 * PICOWEBSOCKET_VIEW_BUFFER_SIZE);
+    emulated.server.memory_budget = &budget;
+    PicoWebsocket::Emulator::Client socket(emulated.network);
+    PicoWebsocket::Client websocket(socket, "/");
+    auto & connection = emulated.connect(websocket);
+
+    websocket.write((const uint8_t *)"abc", 3);
+    websocket.write((const uint8_t *)"defg", 4);
+    emulated.run([] {});
+
+    size_t size;
+    TEST_ASSERT_NOT_NULL(connection.view(size));
+    TEST_ASSERT_EQUAL(PICOWEBSOCKET_VIEW_BUFFER_SIZE, budget.used());
+    connection.consume(size);
+
+    // under pressure, the drained buffer is given back
+    const size_t pressure = 3 * PICOWEBSOCKET_VIEW_BUFFER_SIZE;
+    TEST_ASSERT_TRUE(budget.acquire(pressure));
+    TEST_ASSERT_NULL(connection.view(size));
+    TEST_ASSERT_EQUAL(pressure, budget.used());
+
+    budget.release(pressure);
+    const uint8_t * view = connection.view(size);
+    TEST_ASSERT_EQUAL(4, size);
+    TEST_ASSERT_EQUAL_MEMORY("defg", view, 4);
+    connection.consume(size);
+
+    // the buffer is kept until the connection is gone
+    TEST_ASSERT_EQUAL(PICOWEBSOCKET_VIEW_BUFFER_SIZE, budget.used());
+    emulated.connections.clear();
+    TEST_ASSERT_EQUAL(0, budget.used());
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_view_in_place);
+    RUN_TEST(test_view_mixed_with_read);
+    RUN_TEST(test_view_never_spans_frames);
+    RUN_TEST(test_view_buffer_charged_to_budget);
+    return UNITY_END();
+}